@@ -2,62 +2,543 @@
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <cctype>
 #include <limits>
 #include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <unordered_set>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <future>
 using namespace std;
 
+//Default databases, used when the program serves a single library.
 const string bookDataBase = "books.csv";
 const string userDataBase = "users.csv";
 
+//On-disk formats of the databases.
+enum StorageFormat {CSV_STORAGE, COMPACT_STORAGE};
+
+//Function that returns the compact database that goes with a CSV database, e.g. books.csv -> books.lmz.
+string compactPathFor(const string& csvPath){
+	
+	size_t dot = csvPath.rfind('.');
+	size_t slash = csvPath.find_last_of("/\\");
+	
+	if (dot == string::npos || (slash != string::npos && dot < slash)){
+		return csvPath + ".lmz";
+	}
+	
+	return csvPath.substr(0, dot) + ".lmz";
+}
+
+class ISBN{
+	
+	private:
+		
+		//The whole ISBN is packed into a single 64-bit key.
+		//Bits 0-49 hold the number, bits 50-54 the digit count of legacy catalog numbers, bits 60-62 the kind.
+		//An unvalidated ISBN keeps its text in a shared pool and its value is the position in that pool.
+		uint64_t key;
+		
+		static const uint64_t valueMask = (uint64_t(1) << 50) - 1;
+		static const int lengthShift = 50;
+		static const int kindShift = 60;
+		
+		enum Kind {EMPTY = 0, ISBN13 = 1, ISBN10 = 2, LEGACY = 3, UNVALIDATED = 4};
+		
+		ISBN (uint64_t k) : key(k) {}
+		
+		Kind getKind() const {return static_cast<Kind>((key >> kindShift) & 7);}
+		
+		//Texts of the unvalidated ISBNs, each stored once however many records share it.
+		struct TextPool{
+			mutex lock;
+			vector<string> texts;
+			unordered_map<string, uint64_t> positions;
+		};
+		
+		static TextPool& textPool(){
+			static TextPool pool;
+			return pool;
+		}
+		
+		//Removes the hyphens and spaces people usually type inside an ISBN.
+		static string stripSeparators(const string& text){
+			
+			string digits;
+			
+			for (char c : text){
+				if (c != '-' && c != ' '){
+					digits += c;
+				}
+			}
+			
+			return digits;
+		}
+		
+		static bool allDigits(const string& text, size_t count){
+			
+			for (size_t i = 0; i < count; ++i){
+				if (text[i] < '0' || text[i] > '9'){
+					return false;
+				}
+			}
+			
+			return true;
+		}
+		
+		//Computes the ISBN-13 check digit from the first 12 digits.
+		static int isbn13CheckDigit(uint64_t first12){
+			
+			int sum = 0;
+			
+			for (int i = 11; i >= 0; --i){
+				int digit = first12 % 10;
+				first12 /= 10;
+				sum += (i % 2 == 0) ? digit : digit * 3;
+			}
+			
+			return (10 - sum % 10) % 10;
+		}
+		
+		//Computes the ISBN-10 check digit (10 stands for 'X') from the first 9 digits.
+		static int isbn10CheckDigit(uint64_t first9){
+			
+			int sum = 0;
+			
+			for (int weight = 2; weight <= 10; ++weight){
+				sum += (first9 % 10) * weight;
+				first9 /= 10;
+			}
+			
+			return (11 - sum % 11) % 11;
+		}
+		
+	public:
+		
+		//Constructor - an empty ISBN.
+		ISBN () : key(0) {}
+		
+		//Parses an ISBN-10 or ISBN-13 and checks its check digit. Returns false if the text is not a valid ISBN.
+		//An ISBN-10 is stored as its 978 ISBN-13 equivalent so both forms of the same book compare equal.
+		static bool parse(const string& text, ISBN& result){
+			
+			string digits = stripSeparators(text);
+			
+			if (digits.length() == 13 && allDigits(digits, 13)){
+				
+				uint64_t value = stoull(digits);
+				
+				if ((digits.compare(0, 3, "978") != 0 && digits.compare(0, 3, "979") != 0) || isbn13CheckDigit(value / 10) != int(value % 10)){
+					return false;
+				}
+				
+				result = ISBN((uint64_t(ISBN13) << kindShift) | value);
+				return true;
+			}
+			
+			if (digits.length() == 10 && allDigits(digits, 9)){
+				
+				uint64_t first9 = stoull(digits.substr(0, 9));
+				char last = digits[9];
+				int check = (last == 'X' || last == 'x') ? 10 : last - '0';
+				
+				if (check < 0 || check > 10 || isbn10CheckDigit(first9) != check){
+					return false;
+				}
+				
+				uint64_t first12 = 978000000000ULL + first9;
+				result = ISBN((uint64_t(ISBN10) << kindShift) | (first12 * 10 + isbn13CheckDigit(first12)));
+				return true;
+			}
+			
+			return false;
+		}
+		
+		//Same as parse, but also accepts the plain numeric catalog numbers found in older databases (e.g. "2236").
+		static bool parseLegacy(const string& text, ISBN& result){
+			
+			if (text.empty()){
+				result = ISBN();
+				return true;
+			}
+			
+			if (parse(text, result)){
+				return true;
+			}
+			
+			if (text.length() > 15 || !allDigits(text, text.length())){
+				return false;
+			}
+			
+			result = ISBN((uint64_t(LEGACY) << kindShift) | (uint64_t(text.length()) << lengthShift) | stoull(text));
+			return true;
+		}
+		
+		//Keeps text that is not a valid ISBN exactly as it was written, so it is not lost when the file is saved again.
+		static ISBN unvalidated(const string& text){
+			
+			TextPool& pool = textPool();
+			lock_guard<mutex> guard(pool.lock);
+			
+			unordered_map<string, uint64_t>::iterator found = pool.positions.find(text);
+			
+			if (found != pool.positions.end()){
+				return ISBN((uint64_t(UNVALIDATED) << kindShift) | found->second);
+			}
+			
+			uint64_t position = pool.texts.size();
+			pool.texts.push_back(text);
+			pool.positions[text] = position;
+			
+			return ISBN((uint64_t(UNVALIDATED) << kindShift) | position);
+		}
+		
+		//Rebuilds an ISBN from the two parts returned by getTag and getValue.
+		static ISBN fromParts(unsigned tag, uint64_t value){
+			return ISBN((uint64_t(tag >> 5) << kindShift) | (uint64_t(tag & 31) << lengthShift) | (value & valueMask));
+		}
+		
+		//Kind and digit count packed into 8 bits, and the number itself. Used by the compact database format.
+		//The value of an unvalidated ISBN only means something in this process, so its text is stored instead.
+		unsigned getTag() const {return (getKind() << 5) | ((key >> lengthShift) & 31);}
+		uint64_t getValue() const {return key & valueMask;}
+		static bool isUnvalidatedTag(unsigned tag) {return (tag >> 5) == UNVALIDATED;}
+		
+		bool isEmpty() const {return getKind() == EMPTY;}
+		bool isLegacy() const {return getKind() == LEGACY;}
+		bool isUnvalidated() const {return getKind() == UNVALIDATED;}
+		
+		//Key used for indexing and comparisons. Both forms of the same ISBN share one key.
+		uint64_t getKey() const{
+			
+			if (getKind() == ISBN10){
+				return (uint64_t(ISBN13) << kindShift) | getValue();
+			}
+			
+			return key;
+		}
+		
+		//Textual form, used only for display and the CSV files.
+		string toString() const{
+			
+			switch (getKind()){
+				
+				case ISBN13:
+					return to_string(getValue());
+				
+				case ISBN10: {
+					
+					uint64_t first9 = (getValue() / 10) % 1000000000ULL;
+					int check = isbn10CheckDigit(first9);
+					string digits = to_string(first9);
+					
+					return string(9 - digits.length(), '0') + digits + (check == 10 ? 'X' : char('0' + check));
+				}
+				
+				case LEGACY: {
+					
+					size_t length = (key >> lengthShift) & 31;
+					string digits = to_string(getValue());
+					
+					return string(length - digits.length(), '0') + digits;
+				}
+				
+				case UNVALIDATED: {
+					
+					TextPool& pool = textPool();
+					lock_guard<mutex> guard(pool.lock);
+					
+					return pool.texts[getValue()];
+				}
+				
+				default:
+					return "";
+			}
+		}
+		
+		bool operator==(const ISBN& other) const {return getKey() == other.getKey();}
+		bool operator!=(const ISBN& other) const {return getKey() != other.getKey();}
+		bool operator<(const ISBN& other) const {return getKey() < other.getKey();}
+};
+
+ostream& operator<<(ostream& out, const ISBN& isbn){
+	return out << isbn.toString();
+}
+
+//Writes the compact database format: LEB128 varints, zigzag-coded deltas and length-prefixed strings.
+class CompactWriter{
+	
+	private:
+		
+		ostream& out;
+		
+	public:
+		
+		CompactWriter(ostream& o) : out(o) {}
+		
+		//Writes a number using 7 bits per byte, so small numbers take a single byte.
+		void writeVarint(uint64_t value){
+			
+			while (value >= 0x80){
+				out.put(static_cast<char>((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			
+			out.put(static_cast<char>(value));
+		}
+		
+		//Writes the difference from the previous number, zigzag-coded so small negative steps stay small.
+		void writeDelta(uint64_t value, uint64_t previous){
+			
+			int64_t delta = static_cast<int64_t>(value - previous);
+			writeVarint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+		}
+		
+		void writeString(const string& text){
+			
+			writeVarint(text.size());
+			out.write(text.data(), text.size());
+		}
+		
+		void writeMagic(const char* magic){
+			out.write(magic, 4);
+		}
+};
+
+//Streaming decoder for the compact database format. Reads straight from the file, one value at a time.
+class CompactReader{
+	
+	private:
+		
+		istream& in;
+		
+	public:
+		
+		CompactReader(istream& i) : in(i) {}
+		
+		bool readVarint(uint64_t& value){
+			
+			value = 0;
+			
+			for (int shift = 0; shift < 64; shift += 7){
+				
+				int byte = in.get();
+				
+				if (byte == EOF){
+					return false;
+				}
+				
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				
+				if ((byte & 0x80) == 0){
+					return true;
+				}
+			}
+			
+			return false; //Too many bytes for a 64-bit number.
+		}
+		
+		bool readDelta(uint64_t previous, uint64_t& value){
+			
+			uint64_t zigzag;
+			
+			if (!readVarint(zigzag)){
+				return false;
+			}
+			
+			value = previous + ((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+			return true;
+		}
+		
+		bool readString(string& text){
+			
+			uint64_t length;
+			
+			if (!readVarint(length) || length > (1 << 20)){
+				return false;
+			}
+			
+			text.resize(length);
+			return length == 0 || in.read(&text[0], length);
+		}
+		
+		bool readMagic(const char* magic){
+			
+			char found[4];
+			return in.read(found, 4) && equal(found, found + 4, magic);
+		}
+};
+
+//One physical copy of a title.
+struct BookCopy{
+	uint32_t slot; //Position of the copy on its title's shelf. See Book.
+	uint32_t timesBorrowed;
+};
+
 class Book{
 	
 	private:
 		
 		string title;
 		string author;
-		string isbn;
-		bool availability_status;
+		ISBN isbn;
+		
+		//Copy table. The shelf lists the copy numbers with the available copies first,
+		//so a copy is available when its slot is below availableCount and borrowing or returning moves a single entry.
+		vector<BookCopy> copies;
+		vector<uint32_t> shelf;
+		uint32_t availableCount;
+		
+		//Private method that swaps two shelf entries and keeps the copies' slots in step.
+		void swapSlots(uint32_t a, uint32_t b){
+			
+			swap(shelf[a], shelf[b]);
+			copies[shelf[a]].slot = a;
+			copies[shelf[b]].slot = b;
+		}
 		
 	public:
 		
-		//Constructor - initializes an object upon calling. 
-		Book (string t = "", string a = "", string i = "", bool s = true ) : title(t), author(a), isbn(i),
-		availability_status(s) {}
+		//Constructor - initializes an object upon calling. The title starts without copies.
+		Book (string t = "", string a = "", ISBN i = ISBN()) : title(t), author(a), isbn(i), availableCount(0) {}
 		
 		//Setter functions - assigning user value to private variables
 		void setTitle(string t) {title = t;}
 		void setAuthor (string a) {author = a;}
-		void setISBN (string i) {isbn = i;}
-		void setStatus (bool s) {availability_status = s;}
+		void setISBN (ISBN i) {isbn = i;}
 		
 		//Getter functions - getting value from the private variables
 		string getTitle() const {return title;}
 		string getAuthor() const {return author;}
-		string getISBN() const {return isbn;}
-		bool getStatus() const{return availability_status;}
+		const ISBN& getISBN() const {return isbn;}
+		bool getStatus() const{return availableCount > 0;}
+		
+		uint32_t getCopyCount() const {return copies.size();}
+		uint32_t getAvailableCopies() const {return availableCount;}
+		bool isCopyAvailable(uint32_t copyNumber) const {return copies[copyNumber].slot < availableCount;}
+		uint32_t getTimesBorrowed(uint32_t copyNumber) const {return copies[copyNumber].timesBorrowed;}
+		
+		//Adds a copy of the title.
+		void addCopy(bool available, uint32_t timesBorrowed = 0){
+			
+			uint32_t copyNumber = copies.size();
+			
+			copies.push_back(BookCopy{static_cast<uint32_t>(shelf.size()), timesBorrowed});
+			shelf.push_back(copyNumber);
+			
+			if (available){
+				swapSlots(copies[copyNumber].slot, availableCount);
+				++availableCount;
+			}
+		}
+		
+		//Lends out any available copy. Returns its copy number, or -1 if every copy is borrowed.
+		int checkOut(){
+			
+			if (availableCount == 0){
+				return -1;
+			}
+			
+			uint32_t copyNumber = shelf[--availableCount];
+			++copies[copyNumber].timesBorrowed;
+			
+			return copyNumber;
+		}
+		
+		//Takes back the most recently lent copy. Returns false if no copy is borrowed.
+		bool checkIn(){
+			
+			if (availableCount == shelf.size()){
+				return false;
+			}
+			
+			++availableCount;
+			return true;
+		}
+		
+		//Removes one available copy. Returns false if every copy is borrowed.
+		bool removeAvailableCopy(){
+			
+			if (availableCount == 0){
+				return false;
+			}
+			
+			//Takes the last available copy off the shelf and moves the last borrowed copy into its slot.
+			uint32_t slot = --availableCount;
+			uint32_t removed = shelf[slot];
+			uint32_t lastSlot = shelf.size() - 1;
+			
+			if (slot != lastSlot){
+				shelf[slot] = shelf[lastSlot];
+				copies[shelf[slot]].slot = slot;
+			}
+			shelf.pop_back();
+			
+			//Gives the last copy the removed copy's number, so copy numbers stay dense.
+			uint32_t lastCopy = copies.size() - 1;
+			
+			if (removed != lastCopy){
+				copies[removed] = copies[lastCopy];
+				shelf[copies[removed].slot] = removed;
+			}
+			copies.pop_back();
+			
+			return true;
+		}
 		
+		//Function that returns the properties of one copy, as a line of the books database.
+		string toCSV(uint32_t copyNumber) const{ 
+			
+			return title + "," + author + "," + isbn.toString() + "," + (isCopyAvailable(copyNumber) ? "Available" : "Borrowed") + ","
+				+ to_string(getTimesBorrowed(copyNumber));
+		}
 		
-		//Function that returns all object properties.
-		string toCSV() const{ 
+		//Function that returns the title's properties for display, with the copy counts when there is more than one copy.
+		string getDetails() const{
+			
+			string details = title + "," + author + "," + isbn.toString() + "," + (getStatus() ? "Available" : "Borrowed");
+			
+			if (copies.size() > 1){
+				details += " (" + to_string(availableCount) + " of " + to_string(copies.size()) + " copies available)";
+			}
 			
-			return title + "," + author + "," + isbn + "," + (availability_status ? "Available" : "Borrowed");
+			return details;
 		}
 		
 };
 
+//A book held by a user.
+struct Loan{
+	string title;
+	string author;
+	ISBN isbn;
+};
+
 class LibraryUser{
 	
 	private:
 		
 		string name;
 		string id;
-		vector <Book> borrowedBooklist;
+		vector <Loan> borrowedBooklist;
 		
 	public:
 		
 		//Constructor that initializes user details.
-		//Initializes with empty values. In the case of Book b, initialized with an empty vector.
-		LibraryUser (string n = "", string i = "", Book b = Book()) : name(n), id(i), borrowedBooklist() {}
+		//Initializes with empty values. The borrowed book list starts as an empty vector.
+		LibraryUser (string n = "", string i = "") : name(n), id(i), borrowedBooklist() {}
 		
 		//Setters
 		void setName(string n) {name = n;}
@@ -70,18 +551,32 @@ class LibraryUser{
 		//Method to let user borrow a book.
 		bool borrowBook(Book& book){
 			
-			//It checks the availability status of the book.
-			if (!book.getStatus()){
-				cout << "Sorry, the book is already borrowed." << endl;
+			//It lends out any available copy of the book.
+			if (book.checkOut() < 0){
+				cout << "Sorry, all copies of the book are borrowed." << endl;
 				return false;
 			}
-			//If the book is available, it adds the book to the user's borrowed book list and updates the status.			
-			borrowedBooklist.push_back(book);
-			book.setStatus(false);
+			//If a copy was available, it adds the book to the user's borrowed book list.
+			addBorrowedBook(book);
 			
 			return true;
 		}
 		
+		//Method that tells whether the user has borrowed a title.
+		bool hasBorrowed(const string& title) const{
+			
+			return any_of(borrowedBooklist.begin(), borrowedBooklist.end(), [&title] (const Loan& loan){
+				return loan.title == title;
+			});
+		}
+		
+		//Method that adds a loan to the user's borrowed book list without touching the book's copies.
+		void addBorrowedBook(const Book& book){
+			borrowedBooklist.push_back(Loan{book.getTitle(), book.getAuthor(), book.getISBN()});
+		}
+		
+		const vector<Loan>& getBorrowedBooks() const {return borrowedBooklist;}
+		
 		//Method to display all the borrowed books of the user.
 		void displayBorrowedBooks() const{
 			
@@ -91,34 +586,29 @@ class LibraryUser{
 				return;
 			}
 			
-			for (const auto& book : borrowedBooklist){
+			for (const auto& loan : borrowedBooklist){
 				
-				cout << book.getTitle() << "  " << book.getAuthor() << "  " << book.getISBN() << endl;
+				cout << loan.title << "  " << loan.author << "  " << loan.isbn << endl;
 			}
 		}
 		
-		//Method to return a book to the library.
-		bool returnBook(const string& title, vector <Book>& books){
+		//Method to remove a book from the user's borrowed book list. The library takes the copy back.
+		//The removed loan is stored in returned.
+		bool returnBook(const string& title, Loan& returned){
 			
 			//This statement finds a value from the container based from the basis(predicate).
 			//Checks if the user has borrowed the book.
-			auto userIt = find_if(books.begin(), books.end(), [&title] (const Book& book){
-				return book.getTitle() == title;
+			auto userIt = find_if(borrowedBooklist.begin(), borrowedBooklist.end(), [&title] (const Loan& loan){
+				return loan.title == title;
 			});
 			
-			if(userIt == books.end()){
+			if(userIt == borrowedBooklist.end()){
 				cout << "You have not borrowed this book." << endl;
 				return false; //User didn't borrow this book.
 			} 
 			
-			auto libraryIt = find_if(books.begin(), books.end(), [&title] (const Book& book){
-				return book.getTitle() == title;
-			});
-			
-			if (libraryIt != books.end()){
-				libraryIt->setStatus(true);//Updates the book status in the library to available.
-			}
 			//Removes the book from the user's borrowed book list.
+			returned = *userIt;
 			borrowedBooklist.erase(userIt);
 			
 			return true;
@@ -133,7 +623,7 @@ class LibraryUser{
 			} else{
 				for (int i = 0; i < borrowedBooklist.size(); ++i){
 					
-					details = details + borrowedBooklist[i].getTitle();
+					details = details + borrowedBooklist[i].title;
 					
 					if (i < borrowedBooklist.size() - 1){
 						details += ";";
@@ -146,325 +636,2225 @@ class LibraryUser{
 		}
 };
 
-class Library{
+//Bloom filter over strings. Answers "definitely not present" or "maybe present" without touching the data it summarizes.
+class BloomFilter{
 	
 	private:
 		
-		vector <Book> books;
-		vector <LibraryUser> users;
+		vector<uint64_t> bits;
+		uint64_t bitCount;
+		unsigned hashCount;
+		size_t capacity; //Items the filter was sized for at the target false positive rate.
+		size_t itemCount;
+		double falsePositiveRate;
 		
-		//Private method that loads book data from the books database.
-		void loadBooksFromFile(){
+		//Lookup counters, kept for the statistics screen.
+		mutable uint64_t lookups;
+		mutable uint64_t rejections;
+		mutable uint64_t falsePositives;
+		
+		//FNV-1a hash of the key.
+		static uint64_t hashKey(const string& key){
 			
-			ifstream bookFile(bookDataBase);
+			uint64_t hash = 14695981039346656037ULL;
 			
-			if (!bookFile.is_open()){
-				cerr << "Error: Unable to open file." << endl;
-				return;
+			for (unsigned char c : key){
+				hash ^= c;
+				hash *= 1099511628211ULL;
 			}
 			
-			string line;
-			getline(bookFile, line); //Skips the header line.
+			return hash;
+		}
+		
+		//Second hash derived from the first, made odd so the probe sequence never repeats early.
+		static uint64_t rehash(uint64_t hash){
 			
-				//Reads each line from the file.
-				while(getline(bookFile, line)){
-					
-					size_t pos1 = line.find(',');
-					size_t pos2 = line.find(',', pos1 + 1);
-					size_t pos3 = line.find(',', pos2 + 1);
-					
-					//Ensures that all necessary commas are present.
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 33;
+			
+			return hash | 1;
+		}
+		
+	public:
+		
+		//Constructor that sizes the filter for the expected number of items and the target false positive rate.
+		BloomFilter(size_t expectedItems = 0, double rate = 0.01) : falsePositiveRate(rate), lookups(0), rejections(0), falsePositives(0){
+			reset(expectedItems);
+		}
+		
+		//Empties the filter and sizes it again, leaving room for the expected items to double.
+		void reset(size_t expectedItems){
+			
+			capacity = max<size_t>(expectedItems * 2, 1024);
+			itemCount = 0;
+			
+			//Optimal sizes: m = -n ln(p) / ln(2)^2 bits and k = m / n ln(2) hashes.
+			double ln2 = log(2.0);
+			bitCount = static_cast<uint64_t>(ceil(-(double)capacity * log(falsePositiveRate) / (ln2 * ln2)));
+			hashCount = max(1, static_cast<int>(round((double)bitCount / capacity * ln2)));
+			
+			bits.assign((bitCount + 63) / 64, 0);
+		}
+		
+		void add(const string& key){
+			
+			uint64_t hash = hashKey(key);
+			uint64_t step = rehash(hash);
+			
+			for (unsigned i = 0; i < hashCount; ++i){
+				uint64_t bit = (hash + i * step) % bitCount;
+				bits[bit / 64] |= uint64_t(1) << (bit % 64);
+			}
+			
+			++itemCount;
+		}
+		
+		//Returns false only if the key was never added. Counts the lookup for the statistics.
+		bool mightContain(const string& key) const{
+			
+			uint64_t hash = hashKey(key);
+			uint64_t step = rehash(hash);
+			
+			++lookups;
+			
+			for (unsigned i = 0; i < hashCount; ++i){
+				
+				uint64_t bit = (hash + i * step) % bitCount;
+				
+				if ((bits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0){
+					++rejections;
+					return false;
+				}
+			}
+			
+			return true;
+		}
+		
+		//Called when mightContain let a key through that turned out to be missing.
+		void recordFalsePositive() const {++falsePositives;}
+		
+		//True once more items were added than the filter was sized for. It should then be rebuilt.
+		bool isFull() const {return itemCount > capacity;}
+		
+		//False positive rate expected at the current load: (1 - e^(-kn/m))^k.
+		double expectedFalsePositiveRate() const{
+			return pow(1 - exp(-(double)hashCount * itemCount / bitCount), hashCount);
+		}
+		
+		//Method that prints the filter's size and lookup counters.
+		void printStats(ostream& out, const string& name) const{
+			
+			uint64_t negatives = rejections + falsePositives;
+			ios::fmtflags flags = out.flags();
+			streamsize precision = out.precision();
+			
+			out << name << ": " << itemCount << " items, " << bitCount << " bits, " << hashCount << " hashes" << endl;
+			out << fixed << setprecision(2);
+			out << "  Target false positive rate: " << falsePositiveRate * 100 << "%, expected at current load: "
+				<< expectedFalsePositiveRate() * 100 << "%" << endl;
+			out << "  Lookups: " << lookups << ", rejected by the filter: " << rejections << ", false positives: " << falsePositives;
+			
+			if (negatives > 0){
+				out << " (observed rate " << (double)falsePositives / negatives * 100 << "%)";
+			}
+			
+			out << endl;
+			out.flags(flags);
+			out.precision(precision);
+		}
+};
+
+//Immutable, versioned view of one of the library's stores.
+//The version it points to is freed once the last reader holding it lets go. Saves use the version number to skip
+//writing a store that has not changed since it was last written.
+template <typename T>
+struct Snapshot{
+	unsigned long version;
+	shared_ptr<const vector<T>> items;
+};
+
+class Library{
+	
+	private:
+		
+		//The live stores. Snapshots share them, so a writer copies a store before changing it while a reader still holds it.
+		shared_ptr<vector <Book>> books;
+		shared_ptr<vector <LibraryUser>> users;
+		unsigned long bookVersion;
+		unsigned long userVersion;
+		
+		//Databases of this library. Each branch has its own.
+		const string bookPath;
+		const string userPath;
+		const string compactBookPath;
+		const string compactUserPath;
+		const string userIndexPath;
+		
+		mutable mutex storeMutex; //Guards the live stores and their versions.
+		mutex fileMutex; //Serializes saves to the databases.
+		
+		//Versions of the stores last written to the databases, so a save with nothing new to write is skipped.
+		//Loans in the compact users file are book positions, so that file also records the books version it was written against.
+		//Guarded by fileMutex.
+		unsigned long savedBookVersion;
+		unsigned long savedUserVersion;
+		unsigned long savedUserBookVersion;
+		bool saveEnabled; //When false, changes stay in memory only.
+		StorageFormat storageFormat;
+		
+		//Positions of each title's catalog records, guarded by storeMutex. A title usually has one record.
+		//Copies that differ in author or ISBN get records of their own, so saving writes every row back as it was read.
+		unordered_map<string, vector<size_t>> titleIndex;
+		unordered_map<uint64_t, size_t> isbnIndex; //Position of the first catalog record with each ISBN key. Guarded by storeMutex.
+		
+		//Users are loaded on demand. userOffsets maps every user ID in the users file to the offset of its line,
+		//and userPositions maps the users loaded so far to their place in the users store. Both are guarded by storeMutex.
+		unordered_map<string, uint64_t> userOffsets;
+		unordered_map<string, size_t> userPositions;
+		unordered_map<string, uint32_t> unclaimedLoans; //Borrowed copies per catalog record (see recordKey) not yet matched to a loaded user's loan.
+		bool lazyUsers; //True while some users may still be only in the users file.
+		
+		//Membership filters over the titles and user IDs, so lookups of unknown ones are rejected without touching the stores.
+		//Guarded by storeMutex.
+		BloomFilter titleFilter;
+		BloomFilter userFilter;
+		
+		//Private method that returns the live books for changing. Must be called with storeMutex held.
+		//The store may be replaced by a copy, so positions stay valid across the call but iterators and references do not.
+		vector<Book>& writableBooks(){
+			
+			if (books.use_count() > 1){
+				books = make_shared<vector<Book>>(*books);
+			}
+			
+			++bookVersion;
+			return *books;
+		}
+		
+		//Private method that returns the live users for changing. Must be called with storeMutex held.
+		vector<LibraryUser>& writableUsers(){
+			
+			if (users.use_count() > 1){
+				users = make_shared<vector<LibraryUser>>(*users);
+			}
+			
+			++userVersion;
+			return *users;
+		}
+		
+		//Private method that finds a catalog record of a title, preferring one with a copy on the shelf.
+		//Must be called with storeMutex held.
+		bool findTitle(const string& title, size_t& index) const{
+			
+			auto found = titleIndex.find(title);
+			
+			if (found == titleIndex.end()){
+				return false;
+			}
+			
+			index = found->second.front();
+			
+			for (size_t record : found->second){
+				if ((*books)[record].getStatus()){
+					index = record;
+					break;
+				}
+			}
+			
+			return true;
+		}
+		
+		//Private method that tells whether a catalog record holds copies with this author and ISBN.
+		//The ISBN has to match as written, so the ISBN-10 and ISBN-13 forms of one book stay separate rows.
+		static bool isRecordOf(const Book& book, const string& author, const ISBN& isbn){
+			
+			return book.getAuthor() == author && book.getISBN().getTag() == isbn.getTag() && book.getISBN().getValue() == isbn.getValue();
+		}
+		
+		//Private method that returns the key of a catalog record, as used by unclaimedLoans and the compact users file.
+		static string recordKey(const string& title, const string& author, const ISBN& isbn){
+			return title + '\n' + author + '\n' + to_string(isbn.getTag()) + ':' + to_string(isbn.getValue());
+		}
+		
+		//Private method that finds the first catalog record with an ISBN. Must be called with storeMutex held.
+		bool findISBN(const ISBN& isbn, size_t& index) const{
+			
+			auto found = isbnIndex.find(isbn.getKey());
+			
+			if (found == isbnIndex.end()){
+				return false;
+			}
+			
+			index = found->second;
+			return true;
+		}
+		
+		//Private method that puts a catalog record in the ISBN index, unless its ISBN is empty or already indexed.
+		void indexISBN(size_t index){
+			
+			const ISBN& isbn = (*books)[index].getISBN();
+			
+			if (!isbn.isEmpty()){
+				isbnIndex.insert(make_pair(isbn.getKey(), index));
+			}
+		}
+		
+		//Private method that refills the title filter from the title index. Also drops removed titles.
+		void rebuildTitleFilter(){
+			
+			titleFilter.reset(titleIndex.size());
+			
+			for (const auto& entry : titleIndex){
+				titleFilter.add(entry.first);
+			}
+		}
+		
+		//Private method that refills the user filter from the users index and the loaded users.
+		void rebuildUserFilter(){
+			
+			//Loaded users are usually in the index as well, so each ID is counted and added once.
+			size_t userCount = userOffsets.size();
+			
+			for (const auto& entry : userPositions){
+				if (userOffsets.count(entry.first) == 0){
+					++userCount;
+				}
+			}
+			
+			userFilter.reset(userCount);
+			
+			for (const auto& entry : userOffsets){
+				userFilter.add(entry.first);
+			}
+			
+			for (const auto& entry : userPositions){
+				if (userOffsets.count(entry.first) == 0){
+					userFilter.add(entry.first);
+				}
+			}
+		}
+		
+		//Private method that tells whether text contains the query, ignoring case.
+		static bool containsIgnoreCase(const string& text, const string& query){
+			
+			auto match = search(text.begin(), text.end(), query.begin(), query.end(), [](char a, char b){
+				return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+			});
+			
+			return match != text.end() || query.empty();
+		}
+		
+		//Private method that searches the title or the author of every catalog record in a snapshot.
+		vector<Book> searchBooks(const string& query, bool byAuthor) const{
+			
+			Snapshot<Book> snapshot = snapshotBooks();
+			vector<Book> matches;
+			
+			for (const auto& book : *snapshot.items){
+				if (containsIgnoreCase(byAuthor ? book.getAuthor() : book.getTitle(), query)){
+					matches.push_back(book);
+				}
+			}
+			
+			return matches;
+		}
+		
+		//Private method that looks a title up, letting the filter reject unknown titles first.
+		//Must be called with storeMutex held.
+		bool lookUpTitle(const string& title, size_t& index) const{
+			
+			if (!titleFilter.mightContain(title)){
+				return false;
+			}
+			
+			if (findTitle(title, index)){
+				return true;
+			}
+			
+			titleFilter.recordFalsePositive();
+			return false;
+		}
+		
+		//Private method that looks a user up the same way, loading the user on first use.
+		//Must be called with storeMutex held.
+		bool lookUpUser(const string& userId, size_t& index){
+			
+			if (!userFilter.mightContain(userId)){
+				return false;
+			}
+			
+			if (findUser(userId, index)){
+				return true;
+			}
+			
+			userFilter.recordFalsePositive();
+			return false;
+		}
+		
+		//Private method that rebuilds the title and ISBN indexes after catalog records have moved.
+		void rebuildTitleIndex(){
+			
+			titleIndex.clear();
+			isbnIndex.clear();
+			
+			for (size_t i = 0; i < books->size(); ++i){
+				titleIndex[(*books)[i].getTitle()].push_back(i);
+				indexISBN(i);
+			}
+			
+			rebuildTitleFilter();
+		}
+		
+		//Private method that returns the catalog record with this title, author and ISBN, creating it if there is none.
+		//Must be called with storeMutex held, on a writable store.
+		size_t catalogRecordFor(const string& title, const string& author, const ISBN& isbn){
+			
+			vector<size_t>& records = titleIndex[title];
+			
+			for (size_t index : records){
+				if (isRecordOf((*books)[index], author, isbn)){
+					return index;
+				}
+			}
+			
+			books->emplace_back(title, author, isbn); //Uses emplace_back to construct in place.
+			records.push_back(books->size() - 1);
+			indexISBN(books->size() - 1);
+			
+			//Only a new title needs adding to the filter.
+			if (records.size() == 1){
+				
+				titleFilter.add(title);
+				
+				if (titleFilter.isFull()){
+					rebuildTitleFilter();
+				}
+			}
+			
+			return books->size() - 1;
+		}
+		
+		//Private method that claims one of the copies of a catalog record the books file marks as borrowed.
+		//Must be called with storeMutex held.
+		bool claimLoan(size_t index){
+			
+			const Book& book = (*books)[index];
+			auto unclaimed = unclaimedLoans.find(recordKey(book.getTitle(), book.getAuthor(), book.getISBN()));
+			
+			if (unclaimed == unclaimedLoans.end() || unclaimed->second == 0){
+				return false;
+			}
+			
+			--unclaimed->second;
+			return true;
+		}
+		
+		//Private method that gives a loaded user a loan of a catalog record. Must be called with storeMutex held.
+		//A loan first claims one of the copies the books file marks as borrowed, and borrows an available copy when none is left.
+		void attachLoan(LibraryUser& user, size_t index){
+			
+			if (!claimLoan(index) && writableBooks()[index].checkOut() < 0){
+				return; //Every copy is already lent to someone else.
+			}
+			
+			user.addBorrowedBook((*books)[index]);
+		}
+		
+		//Private method that gives a loaded user a loan of a title. The users CSV file lists loans by title only,
+		//so the loan goes to a record of the title with an unclaimed borrowed copy, or else to one with a copy on the shelf.
+		void attachLoan(LibraryUser& user, const string& title){
+			
+			auto found = titleIndex.find(title);
+			
+			if (found == titleIndex.end()){
+				return;
+			}
+			
+			for (size_t index : found->second){
+				if (claimLoan(index)){
+					user.addBorrowedBook((*books)[index]);
+					return;
+				}
+			}
+			
+			size_t index;
+			
+			if (findTitle(title, index) && writableBooks()[index].checkOut() >= 0){
+				user.addBorrowedBook((*books)[index]);
+			}
+		}
+		
+		//Private method that counts the borrowed copies of each catalog record once the books are loaded.
+		void countUnclaimedLoans(){
+			
+			for (const auto& book : *books){
+				
+				uint32_t lent = book.getCopyCount() - book.getAvailableCopies();
+				
+				if (lent > 0){
+					unclaimedLoans[recordKey(book.getTitle(), book.getAuthor(), book.getISBN())] += lent;
+				}
+			}
+		}
+		
+		//Private method that picks the catalog record a returned loan goes back to: the one it was lent from when that
+		//record still has a borrowed copy, or else any record of the title with one. Must be called with storeMutex held.
+		size_t recordForReturn(const Loan& loan) const{
+			
+			const vector<size_t>& records = titleIndex.at(loan.title);
+			size_t fallback = records.front();
+			
+			for (size_t index : records){
+				
+				const Book& book = (*books)[index];
+				
+				if (book.getAvailableCopies() == book.getCopyCount()){
+					continue; //No borrowed copy to take back.
+				}
+				
+				if (isRecordOf(book, loan.author, loan.isbn)){
+					return index;
+				}
+				
+				fallback = index;
+			}
+			
+			return fallback;
+		}
+		
+		//Private method that loads book data from the books database.
+		void loadBooksFromFile(){
+			
+			if (storageFormat == COMPACT_STORAGE){
+				loadBooksFromCompactFile();
+				return;
+			}
+			
+			ifstream bookFile(bookPath);
+			
+			if (!bookFile.is_open()){
+				cerr << "Error: Unable to open file." << endl;
+				return;
+			}
+			
+			string line;
+			getline(bookFile, line); //Skips the header line.
+			
+				//Reads each line from the file.
+				while(getline(bookFile, line)){
+					
+					if (!line.empty() && line.back() == '\r'){
+						line.pop_back(); //Files saved on Windows end each line with CRLF.
+					}
+					
+					size_t pos1 = line.find(',');
+					size_t pos2 = line.find(',', pos1 + 1);
+					size_t pos3 = line.find(',', pos2 + 1);
+					
+					//Ensures that all necessary commas are present.
 					if (pos1 != string::npos && pos2 != string::npos && pos3 != string::npos){
 						
 						
 						string title = line.substr(0, pos1); 
 						string author = line.substr(pos1 + 1, pos2 - pos1 - 1);
-						string isbn = line.substr(pos2 + 1, pos3 - pos2 -1);
-						string statusStr = line.substr(pos3 + 1);
+						string isbnStr = line.substr(pos2 + 1, pos3 - pos2 -1);
+						
+						//Files written before the copy counters were kept have no TIMES_BORROWED column.
+						size_t pos4 = line.find(',', pos3 + 1);
+						string statusStr = line.substr(pos3 + 1, pos4 == string::npos ? string::npos : pos4 - pos3 - 1);
 						bool status = (statusStr == "Available");
+						uint32_t timesBorrowed = pos4 == string::npos ? 0 : strtoul(line.c_str() + pos4 + 1, nullptr, 10);
+						
+						ISBN isbn;
+						if (!ISBN::parseLegacy(isbnStr, isbn)){
+							cerr << "Warning: Invalid ISBN \"" << isbnStr << "\" for \"" << title << "\" is kept as text." << endl;
+							isbn = ISBN::unvalidated(isbnStr);
+						}
 						
-						books.emplace_back(title, author, isbn, status); //Adds the book to the vector. Uses emplace_back to construct in place.
+						//Every line is one copy. Copies with the same title, author and ISBN share one catalog record.
+						(*books)[catalogRecordFor(title, author, isbn)].addCopy(status, timesBorrowed);
 					}
 				}	
 				
 				bookFile.close(); //Close the file after reading.
 		}
 		
-		//Private method that loads user data from the users database.
-		void loadUsersFromFile(){
+		//Private method that decodes the compact books database while reading it.
+		void loadBooksFromCompactFile(){
 			
-			ifstream userFile(userDataBase);
+			ifstream bookFile(compactBookPath, ios::binary);
 			
-			if(!userFile.is_open()){
+			if (!bookFile.is_open()){
 				cerr << "Error: Unable to open file." << endl;
 				return;
-			} 
+			}
 			
-			string line;
-			getline(userFile, line); //Skips the header line.
+			CompactReader reader(bookFile);
+			uint64_t authorCount;
 			
-			//Reads each line from the file.
-
-			while(getline(userFile, line)){
+			if (!reader.readMagic("LMB2") || !reader.readVarint(authorCount)){
+				cerr << "Error: The books file is not in the compact format." << endl;
+				return;
+			}
+			
+			//Reads the author dictionary.
+			vector<string> authors(authorCount);
+			
+			for (auto& author : authors){
+				if (!reader.readString(author)){
+					cerr << "Error: The books file is damaged." << endl;
+					return;
+				}
+			}
+			
+			uint64_t bookCount;
+			uint64_t previousValue = 0;
+			
+			if (!reader.readVarint(bookCount)){
+				cerr << "Error: The books file is damaged." << endl;
+				return;
+			}
+			
+			//Each title is its name, its author's position in the dictionary, its ISBN and its copy table.
+			//Each copy is its borrow counter with the status in the lowest bit.
+			for (uint64_t i = 0; i < bookCount; ++i){
 				
-				size_t pos1 = line.find(",");
-				if (pos1 == string::npos) continue; // Skip if no comma found
+				string title;
+				uint64_t authorPosition, isbnTag, copyCount;
 				
-				size_t pos2 = line.find(",", pos1 + 1);
-				if (pos2 == string::npos) continue; // Skip if second comma not found
+				if (!reader.readString(title) || !reader.readVarint(authorPosition) || !reader.readVarint(isbnTag)
+					|| authorPosition >= authors.size()){
 					
-					string name = line.substr(0, pos1);					
-					string id = line.substr(pos1 + 1, pos2 - pos1 - 1);
+					cerr << "Error: The books file is damaged." << endl;
+					return;
+				}
+				
+				//An ISBN that failed validation is stored as its text instead of a number.
+				ISBN isbn;
+				
+				if (ISBN::isUnvalidatedTag(isbnTag)){
+					
+					string isbnText;
+					
+					if (!reader.readString(isbnText)){
+						cerr << "Error: The books file is damaged." << endl;
+						return;
+					}
+					
+					isbn = ISBN::unvalidated(isbnText);
+					
+				} else{
+					
+					uint64_t isbnValue;
+					
+					if (!reader.readDelta(previousValue, isbnValue)){
+						cerr << "Error: The books file is damaged." << endl;
+						return;
+					}
 					
-					LibraryUser user(name, id); //Creates a user object with the name and id.
+					previousValue = isbnValue;
+					isbn = ISBN::fromParts(isbnTag, isbnValue);
+				}
+				
+				if (!reader.readVarint(copyCount)){
+					cerr << "Error: The books file is damaged." << endl;
+					return;
+				}
+				
+				Book& book = (*books)[catalogRecordFor(title, authors[authorPosition], isbn)];
+				
+				for (uint64_t j = 0; j < copyCount; ++j){
 					
-					string borrowedBooksStr;
+					uint64_t copy;
 					
-					if (pos2 + 1 < line.length()){
-						borrowedBooksStr = line.substr(pos2 + 1);
-					} else {
-						borrowedBooksStr = "NONE";
+					if (!reader.readVarint(copy)){
+						cerr << "Error: The books file is damaged." << endl;
+						return;
 					}
 					
-					//Processes the borrowed books string if it's not "NONE" or empty.
-					if (borrowedBooksStr != "NONE" && !borrowedBooksStr.empty()){
+					book.addCopy((copy & 1) == 0, copy >> 1);
+				}
+			}
+		}
+		
+		//Private method that loads user data from the users database.
+		//Users in the CSV file are only indexed here. Each one is read the first time it is asked for.
+		void loadUsersFromFile(){
+			
+			if (storageFormat == COMPACT_STORAGE){
+				loadUsersFromCompactFile();
+				return;
+			}
+			
+			lazyUsers = true;
+			
+			if (!loadUserIndex()){
+				buildUserIndex();
+			}
+		}
+		
+		//Private method that finds the ID in a line of the users file. Returns false if the line is malformed.
+		static bool userIdOfLine(const string& line, string& id){
+			
+			size_t pos1 = line.find(",");
+			if (pos1 == string::npos) return false; // Skip if no comma found
+			
+			size_t pos2 = line.find(",", pos1 + 1);
+			if (pos2 == string::npos) return false; // Skip if second comma not found
+			
+			id = line.substr(pos1 + 1, pos2 - pos1 - 1);
+			return true;
+		}
+		
+		//Private method that builds a user from a line of the users file. Must be called with storeMutex held.
+		bool parseUserLine(string line, LibraryUser& result){
+			
+			if (!line.empty() && line.back() == '\r'){
+				line.pop_back(); //Files saved on Windows end each line with CRLF.
+			}
+			
+			size_t pos1 = line.find(",");
+			if (pos1 == string::npos) return false; // Skip if no comma found
+			
+			size_t pos2 = line.find(",", pos1 + 1);
+			if (pos2 == string::npos) return false; // Skip if second comma not found
+				
+				string name = line.substr(0, pos1);					
+				string id = line.substr(pos1 + 1, pos2 - pos1 - 1);
+				
+				LibraryUser user(name, id); //Creates a user object with the name and id.
+				
+				string borrowedBooksStr;
+				
+				if (pos2 + 1 < line.length()){
+					borrowedBooksStr = line.substr(pos2 + 1);
+				} else {
+					borrowedBooksStr = "NONE";
+				}
+				
+				//Processes the borrowed books string if it's not "NONE" or empty.
+				if (borrowedBooksStr != "NONE" && !borrowedBooksStr.empty()){
+					
+					size_t start = 0;
+					size_t end = borrowedBooksStr.find(";");
+					
+					while (end != string::npos){
 						
-						size_t start = 0;
-						size_t end = borrowedBooksStr.find(";");
+						string bookTitle = borrowedBooksStr.substr(start, end - start);
 						
-						while (end != string::npos){
-							
-							string bookTitle = borrowedBooksStr.substr(start, end - start);
-							
-							// Find the book in the library's main collection
-							auto bookIt = find_if(books.begin(), books.end(), [&bookTitle](Book& book){
-								return book.getTitle() == bookTitle;
-							});
-							
-							if (bookIt != books.end()){
-								bookIt->setStatus(false); // Mark the book as borrowed.
-								user.borrowBook(*bookIt);
-							}	
-							
-							start = end + 1;
-							end = borrowedBooksStr.find(";", start);
-						}
+						// Find the book in the library's main collection
+						attachLoan(user, bookTitle);
 						
-						// Handle the last book title after the final semicolon.
-						string lastBookTitle = borrowedBooksStr.substr(start);
-						if (!lastBookTitle.empty()){
-							
-							auto bookIt = find_if(books.begin(), books.end(), [&lastBookTitle](Book& book){
-								return book.getTitle() == lastBookTitle;
-							});
-							
-							if (bookIt != books.end()){
-								bookIt->setStatus(false); // Mark the book as borrowed.
-								user.borrowBook(*bookIt);
-							}
-							
-						}												
+						start = end + 1;
+						end = borrowedBooksStr.find(";", start);
+					}
+					
+					// Handle the last book title after the final semicolon.
+					string lastBookTitle = borrowedBooksStr.substr(start);
+					if (!lastBookTitle.empty()){
 						
+						attachLoan(user, lastBookTitle);
+						
+					}												
+					
+				}
+				
+				result = user;
+				return true;
+		}
+		
+		//Private method that describes a file by its size and modification time, or returns "" if the file is missing.
+		//The time includes nanoseconds where the system keeps them, so an edit in the same second as a save still shows.
+		static string fileStamp(const string& path){
+			
+			struct stat info;
+			
+			if (stat(path.c_str(), &info) != 0){
+				return "";
+			}
+			
+			long nanoseconds = 0;
+			
+		#if defined(__APPLE__)
+			nanoseconds = info.st_mtimespec.tv_nsec;
+		#elif !defined(_WIN32)
+			nanoseconds = info.st_mtim.tv_nsec;
+		#endif
+			
+			return to_string(static_cast<long long>(info.st_size)) + "," + to_string(static_cast<long long>(info.st_mtime)) + "," + to_string(nanoseconds);
+		}
+		
+		//Private method that scans the users file once and records the offset of every user's line.
+		void buildUserIndex(){
+			
+			userOffsets.clear();
+			
+			ifstream userFile(userPath, ios::binary);
+			
+			if(!userFile.is_open()){
+				cerr << "Error: Unable to open file." << endl;
+				return;
+			} 
+			
+			string line;
+			getline(userFile, line); //Skips the header line.
+			
+			uint64_t offset = userFile.tellg();
+			
+			while (getline(userFile, line)){
+				
+				string id;
+				
+				//The first line of an ID wins, as it always has for getUserById.
+				if (userIdOfLine(line, id)){
+					userOffsets.insert(make_pair(id, offset));
+				}
+				
+				offset = userFile.tellg();
+			}
+			
+			writeUserIndex(userOffsets);
+		}
+		
+		//Private method that writes the index next to the users file, tagged with the size and modification time of the
+		//file it describes. Where the time only counts whole seconds, an edit that keeps the size within the second of a
+		//save goes unnoticed here, but readUserAt still checks every ID and rebuilds the index on a mismatch.
+		void writeUserIndex(const unordered_map<string, uint64_t>& offsets) const{
+			
+			ofstream indexFile(userIndexPath);
+			
+			if (!indexFile){
+				cerr << "Error: Unable to save the users index." << endl;
+				return;
+			}
+			
+			indexFile << "USERS_INDEX," << fileStamp(userPath) << endl;
+			
+			for (const auto& entry : offsets){
+				indexFile << entry.first << "," << entry.second << endl;
+			}
+		}
+		
+		//Private method that reads the index next to the users file. Returns false if it is missing or out of date.
+		bool loadUserIndex(){
+			
+			ifstream indexFile(userIndexPath);
+			string line;
+			
+			if (!indexFile.is_open() || !getline(indexFile, line) || line != "USERS_INDEX," + fileStamp(userPath)){
+				return false;
+			}
+			
+			while (getline(indexFile, line)){
+				
+				size_t comma = line.rfind(',');
+				
+				if (comma == string::npos){
+					userOffsets.clear();
+					return false;
+				}
+				
+				userOffsets[line.substr(0, comma)] = strtoull(line.c_str() + comma + 1, nullptr, 10);
+			}
+			
+			return true;
+		}
+		
+		//Private method that parses the line at the given offset of the users file. Fails if it is not the expected user's line.
+		bool readUserAt(uint64_t offset, const string& userId, LibraryUser& user){
+			
+			ifstream userFile(userPath, ios::binary);
+			string line, id;
+			
+			if (!userFile.is_open() || !userFile.seekg(offset) || !getline(userFile, line)){
+				return false;
+			}
+			
+			return userIdOfLine(line, id) && id == userId && parseUserLine(line, user);
+		}
+		
+		//Private method that finds a user's place in the users store, loading the user from the file on first use.
+		//Must be called with storeMutex held.
+		bool findUser(const string& userId, size_t& index){
+			
+			auto loaded = userPositions.find(userId);
+			
+			if (loaded != userPositions.end()){
+				index = loaded->second;
+				return true;
+			}
+			
+			auto offset = userOffsets.find(userId);
+			
+			if (offset == userOffsets.end()){
+				return false;
+			}
+			
+			LibraryUser user;
+			
+			if (!readUserAt(offset->second, userId, user)){
+				
+				//The users file changed behind the index. Rebuilds the index and tries once more.
+				buildUserIndex();
+				rebuildUserFilter();
+				offset = userOffsets.find(userId);
+				
+				if (offset == userOffsets.end() || !readUserAt(offset->second, userId, user)){
+					return false;
+				}
+			}
+			
+			writableUsers().push_back(user);
+			index = users->size() - 1;
+			userPositions[userId] = index;
+			
+			return true;
+		}
+		
+		//Private method that tells whether a user exists, loaded or not. Must be called with storeMutex held.
+		bool isKnownUser(const string& userId) const{
+			return userPositions.count(userId) > 0 || userOffsets.count(userId) > 0;
+		}
+		
+		//Private method that maps every loaded user ID to its place in the users store. The first user with an ID wins.
+		void rebuildUserPositions(){
+			
+			userPositions.clear();
+			
+			for (size_t i = 0; i < users->size(); ++i){
+				userPositions.insert(make_pair((*users)[i].getID(), i));
+			}
+		}
+		
+		//Private method that loads every user still only in the users file, keeping the file's order.
+		//Must be called with storeMutex held.
+		void loadAllUsers(){
+			
+			if (!lazyUsers){
+				return;
+			}
+			
+			vector<LibraryUser> ordered;
+			vector<bool> placed(users->size(), false);
+			unordered_set<string> seen;
+			
+			ifstream userFile(userPath, ios::binary);
+			string line;
+			getline(userFile, line); //Skips the header line.
+			
+			while (getline(userFile, line)){
+				
+				string id;
+				
+				if (!userIdOfLine(line, id) || !isKnownUser(id)){
+					continue; //Skips malformed lines and removed users.
+				}
+				
+				auto loaded = userPositions.find(id);
+				LibraryUser user;
+				
+				if (seen.insert(id).second && loaded != userPositions.end()){
+					ordered.push_back((*users)[loaded->second]);
+					placed[loaded->second] = true;
+				} else if (parseUserLine(line, user)){
+					ordered.push_back(user);
+				}
+			}
+			
+			//Users added since the file was last saved go last.
+			for (size_t i = 0; i < users->size(); ++i){
+				if (!placed[i]){
+					ordered.push_back((*users)[i]);
+				}
+			}
+			
+			users = make_shared<vector<LibraryUser>>(ordered);
+			++userVersion;
+			
+			rebuildUserPositions();
+			userOffsets.clear();
+			lazyUsers = false;
+		}
+		
+		//Private method that writes the users in the users file's order: the loaded ones from memory, the others copied
+		//from the file as they are. Records where each user's line starts when newOffsets is given.
+		//Must be called with fileMutex held.
+		void writeUsersInFileOrder(ostream& out, unordered_map<string, uint64_t>* newOffsets){
+			
+			Snapshot<LibraryUser> snapshot = snapshotUsers();
+			unordered_map<string, const LibraryUser*> loaded;
+			
+			for (const auto& user : *snapshot.items){
+				loaded.insert(make_pair(user.getID(), &user));
+			}
+			
+			ifstream userFile(userPath, ios::binary);
+			unordered_set<string> written;
+			string line;
+			getline(userFile, line); //Skips the header line.
+			
+			while (getline(userFile, line)){
+				
+				if (!line.empty() && line.back() == '\r'){
+					line.pop_back();
+				}
+				
+				string id;
+				bool known;
+				
+				{
+					lock_guard<mutex> lock(storeMutex);
+					known = userIdOfLine(line, id) && isKnownUser(id);
+				}
+				
+				if (!known){
+					continue; //Skips malformed lines and removed users.
+				}
+				
+				bool firstLine = written.insert(id).second;
+				auto user = loaded.find(id);
+				
+				if (firstLine && newOffsets){
+					(*newOffsets)[id] = out.tellp();
+				}
+				
+				if (firstLine && user != loaded.end()){
+					out << user->second->returnUserDetails() << endl;
+				} else{
+					out << line << endl;
+				}
+			}
+			
+			//Users added since the file was last saved go last.
+			for (const auto& user : *snapshot.items){
+				
+				if (written.insert(user.getID()).second){
+					
+					if (newOffsets){
+						(*newOffsets)[user.getID()] = out.tellp();
+					}
+					
+					out << user.returnUserDetails() << endl;
+				}
+			}
+		}
+		
+		//Private method that saves the users file without loading the users that were never asked for.
+		//Must be called with fileMutex held.
+		bool saveUsersInFileOrder(){
+			
+			string tempPath = userPath + ".tmp";
+			ofstream saveUser(tempPath);
+			
+			if (!saveUser){
+				
+				cerr << "Error: Unable to open users file." << endl;
+				return false;
+			}
+			
+			saveUser << "NAME,ID,BORROWED_BOOKS" << endl;
+			
+			unordered_map<string, uint64_t> newOffsets;
+			writeUsersInFileOrder(saveUser, &newOffsets);
+			
+			saveUser.close();
+			
+			if (saveUser.fail()){
+				cerr << "Error: Failed to save users." << endl;
+				remove(tempPath.c_str());
+				return false;
+			}
+			
+			unordered_map<string, uint64_t> offsets;
+			
+			{
+				//Swaps the file and the offsets together, so a user is never read from the new file at an old offset.
+				lock_guard<mutex> lock(storeMutex);
+				
+				remove(userPath.c_str());
+				rename(tempPath.c_str(), userPath.c_str());
+				
+				for (const auto& entry : newOffsets){
+					if (isKnownUser(entry.first)){
+						userOffsets[entry.first] = entry.second;
+					}
+				}
+				
+				offsets = userOffsets;
+			}
+			
+			writeUserIndex(offsets);
+			return true;
+		}
+		
+		//Private method that decodes the compact users database while reading it.
+		void loadUsersFromCompactFile(){
+			
+			ifstream userFile(compactUserPath, ios::binary);
+			
+			if(!userFile.is_open()){
+				cerr << "Error: Unable to open file." << endl;
+				return;
+			}
+			
+			CompactReader reader(userFile);
+			uint64_t userCount;
+			
+			if (!reader.readMagic("LMU2") || !reader.readVarint(userCount)){
+				cerr << "Error: The users file is not in the compact format." << endl;
+				return;
+			}
+			
+			//Each user is a name, an id and the positions of the borrowed catalog records in the books file.
+			for (uint64_t i = 0; i < userCount; ++i){
+				
+				string name, id;
+				uint64_t loanCount;
+				
+				if (!reader.readString(name) || !reader.readString(id) || !reader.readVarint(loanCount)){
+					cerr << "Error: The users file is damaged." << endl;
+					return;
+				}
+				
+				LibraryUser user(name, id);
+				uint64_t bookIndex = 0;
+				
+				for (uint64_t j = 0; j < loanCount; ++j){
+					
+					if (!reader.readDelta(bookIndex, bookIndex)){
+						cerr << "Error: The users file is damaged." << endl;
+						return;
 					}
 					
-					users.emplace_back(user);
+					if (bookIndex < books->size()){
+						attachLoan(user, static_cast<size_t>(bookIndex));
+					}
+				}
 				
+				users->emplace_back(user);
+			}
+			
+			rebuildUserPositions();
+		}
+		
+		//Private method that writes the books in the compact format. Must be called with fileMutex held.
+		bool saveCompactBookFile(){
+			
+			Snapshot<Book> snapshot = snapshotBooks();
+			ofstream saveBook(compactBookPath, ios::binary);
+			
+			if (!saveBook){
+				cerr << "Error: Unable open books file." << endl;
+				return false;
+			}
+			
+			//Builds the author dictionary.
+			vector<string> authors;
+			unordered_map<string, uint64_t> authorIndex;
+			
+			for (const auto& book : *snapshot.items){
+				if (authorIndex.insert(make_pair(book.getAuthor(), authors.size())).second){
+					authors.push_back(book.getAuthor());
+				}
+			}
+			
+			CompactWriter writer(saveBook);
+			writer.writeMagic("LMB2");
+			writer.writeVarint(authors.size());
+			
+			for (const auto& author : authors){
+				writer.writeString(author);
+			}
+			
+			writer.writeVarint(snapshot.items->size());
+			uint64_t previousValue = 0;
+			
+			for (const auto& book : *snapshot.items){
+				
+				writer.writeString(book.getTitle());
+				writer.writeVarint(authorIndex[book.getAuthor()]);
+				writer.writeVarint(book.getISBN().getTag());
+				
+				//An ISBN that failed validation is written as its text instead of a number.
+				if (book.getISBN().isUnvalidated()){
+					writer.writeString(book.getISBN().toString());
+				} else{
+					writer.writeDelta(book.getISBN().getValue(), previousValue);
+					previousValue = book.getISBN().getValue();
+				}
+				
+				writer.writeVarint(book.getCopyCount());
+				
+				for (uint32_t copy = 0; copy < book.getCopyCount(); ++copy){
+					writer.writeVarint((uint64_t(book.getTimesBorrowed(copy)) << 1) | (book.isCopyAvailable(copy) ? 0 : 1));
+				}
+			}
+			
+			saveBook.close();
+			
+			if (saveBook.fail()){
+				cerr << "Error: Failed to save book." << endl;
+				return false;
+			}
+			
+			cout << "Book successfully saved." << endl;
+			return true;
+		}
+		
+		//Private method that writes the users in the compact format. Must be called with fileMutex held.
+		bool saveCompactUserFile(){
+			
+			{
+				lock_guard<mutex> lock(storeMutex);
+				loadAllUsers();
+			}
+			
+			Snapshot<Book> bookSnapshot = snapshotBooks();
+			Snapshot<LibraryUser> userSnapshot = snapshotUsers();
+			ofstream saveUser(compactUserPath, ios::binary);
+			
+			if (!saveUser){
+				cerr << "Error: Unable to open users file." << endl;
+				return false;
+			}
+			
+			//Loans are stored as the positions of the catalog records in the books file.
+			unordered_map<string, uint64_t> positions;
+			
+			for (size_t i = 0; i < bookSnapshot.items->size(); ++i){
+				const Book& book = (*bookSnapshot.items)[i];
+				positions.insert(make_pair(recordKey(book.getTitle(), book.getAuthor(), book.getISBN()), i));
+			}
+			
+			CompactWriter writer(saveUser);
+			writer.writeMagic("LMU2");
+			writer.writeVarint(userSnapshot.items->size());
+			
+			for (const auto& user : *userSnapshot.items){
+				
+				vector<uint64_t> loans;
+				
+				for (const auto& loan : user.getBorrowedBooks()){
+					
+					auto found = positions.find(recordKey(loan.title, loan.author, loan.isbn));
+					
+					if (found != positions.end()){
+						loans.push_back(found->second);
+					}
+				}
+				
+				writer.writeString(user.getName());
+				writer.writeString(user.getID());
+				writer.writeVarint(loans.size());
+				
+				uint64_t previous = 0;
+				
+				for (uint64_t loan : loans){
+					writer.writeDelta(loan, previous);
+					previous = loan;
+				}
+			}
+			
+			saveUser.close();
+			
+			if (saveUser.fail()){
+				cerr << "Error: Failed to save users." << endl;
+				return false;
+			}
+			
+			return true;
+		}
+	
+		//Private method that writes every user to the users database. Must be called with fileMutex held.
+		bool writeUserFile(const vector<LibraryUser>& allUsers){
+			
+			ofstream saveUser(userPath);
+			
+			if (!saveUser){
+				
+				cerr << "Error: Unable to open users file." << endl;
+				return false;
+			}
+			
+			saveUser << "NAME,ID,BORROWED_BOOKS" << endl;
+			
+			for (const auto& user : allUsers){
+				saveUser << user.returnUserDetails() << endl;
+			}
+			
+			saveUser.close();
+			return !saveUser.fail();
+		}
+	
+	public:
+		
+		//Constructor that initializes by loading the values from the given databases. The compact databases and the users
+		//index live next to them. filterFalsePositiveRate sets how often the title and user filters may let an unknown key through.
+		Library(const string& booksFile, const string& usersFile, StorageFormat format = CSV_STORAGE, double filterFalsePositiveRate = 0.01)
+		: books(make_shared<vector<Book>>()), users(make_shared<vector<LibraryUser>>()), bookVersion(0), userVersion(0),
+		bookPath(booksFile), userPath(usersFile), compactBookPath(compactPathFor(booksFile)), compactUserPath(compactPathFor(usersFile)),
+		userIndexPath(usersFile + ".idx"), savedBookVersion(0), savedUserVersion(0), savedUserBookVersion(0), saveEnabled(true),
+		storageFormat(format), lazyUsers(false), titleFilter(0, filterFalsePositiveRate), userFilter(0, filterFalsePositiveRate){
+			
+			loadBooksFromFile();
+			countUnclaimedLoans();
+			loadUsersFromFile();
+			
+			rebuildTitleFilter();
+			rebuildUserFilter();
+			
+			//The databases hold what was just loaded.
+			savedBookVersion = bookVersion;
+			savedUserVersion = userVersion;
+			savedUserBookVersion = bookVersion;
+		}
+		
+		//Method that turns saving to the databases on or off. Used to replay traces without touching the files.
+		void setSaveEnabled(bool enabled){
+			saveEnabled = enabled;
+		}
+		
+		//Method that changes the format used by the next saves. Used to convert the databases.
+		void setStorageFormat(StorageFormat format){
+			
+			lock_guard<mutex> lock(fileMutex);
+			storageFormat = format;
+			
+			//Nothing has been written in the new format yet.
+			savedBookVersion = savedUserVersion = savedUserBookVersion = numeric_limits<unsigned long>::max();
+		}
+		
+		//Method that returns a read-only view of the books. Writers keep committing while the view is iterated.
+		Snapshot<Book> snapshotBooks() const{
+			
+			lock_guard<mutex> lock(storeMutex);
+			return Snapshot<Book>{bookVersion, books};
+		}
+		
+		//Method that returns a read-only view of the users loaded so far.
+		Snapshot<LibraryUser> snapshotUsers() const{
+			
+			lock_guard<mutex> lock(storeMutex);
+			return Snapshot<LibraryUser>{userVersion, users};
+		}
+		
+		//Method that writes the whole catalog in CSV form from a snapshot.
+		void exportCatalog(ostream& out) const{
+			
+			Snapshot<Book> snapshot = snapshotBooks();
+			
+			out << "TITLE,AUTHOR,ISBN,STATUS,TIMES_BORROWED" << endl;
+			 
+			//Writes one line per copy.
+			for (const auto& book : *snapshot.items){
+				for (uint32_t copy = 0; copy < book.getCopyCount(); ++copy){
+					out << book.toCSV(copy) << endl;
+				}
+			}
+		}
+		
+		//Method that saves book data into the books database.
+		void saveBookFile(){ 
+			
+			if (!saveEnabled){
+				return;
+			}
+			
+			//Only one save at a time, so an older snapshot never overwrites a newer one.
+			lock_guard<mutex> lock(fileMutex);
+			unsigned long version = snapshotBooks().version;
+			
+			if (version == savedBookVersion){
+				return; //This version of the books is already on disk.
+			}
+			
+			if (storageFormat == COMPACT_STORAGE){
+				
+				if (saveCompactBookFile()){
+					savedBookVersion = version;
+				}
+				return;
+			}
+			
+			ofstream saveBook(bookPath); 
+			
+			if (!saveBook){
+				
+				cerr << "Error: Unable open books file." << endl;
+				return;
+			}
+			
+			exportCatalog(saveBook);
+			
+			saveBook.close();
+			
+			if (saveBook.fail()){
+				cerr << "Error: Failed to save book." << endl;
+			} else {
+				savedBookVersion = version;
+				cout << "Book successfully saved." << endl;
+			}
+		
+		}
+		
+		//Method that saves user data into the users database.
+		void saveUserFile(){
+			
+			if (!saveEnabled){
+				return;
+			}
+			
+			lock_guard<mutex> lock(fileMutex);
+			Snapshot<LibraryUser> snapshot = snapshotUsers();
+			unsigned long bookVersionUsed = storageFormat == COMPACT_STORAGE ? snapshotBooks().version : savedUserBookVersion;
+			
+			if (snapshot.version == savedUserVersion && bookVersionUsed == savedUserBookVersion){
+				return; //This version of the users is already on disk.
+			}
+			
+			bool saved;
+			
+			if (storageFormat == COMPACT_STORAGE){
+				saved = saveCompactUserFile();
+			} else if (lazyUsers){
+				saved = saveUsersInFileOrder();
+			} else{
+				saved = writeUserFile(*snapshot.items);
+			}
+			
+			if (saved){
+				savedUserVersion = snapshot.version;
+				savedUserBookVersion = bookVersionUsed;
+			}
+		}
+		
+		//Method to add books. Adding a title the library already has adds another copy of it.
+		//Returns false if the ISBN already belongs to another title.
+		bool addBook(const string& title, const string& author, const ISBN& isbn){
+			
+			{
+				lock_guard<mutex> lock(storeMutex);
+				size_t index;
+				
+				if (findISBN(isbn, index) && (*books)[index].getTitle() != title){
+					cout << "Cannot add book: ISBN " << isbn << " already belongs to \"" << (*books)[index].getTitle() << "\"." << endl;
+					return false;
+				}
+				
+				writableBooks();
+				(*books)[catalogRecordFor(title, author, isbn)].addCopy(true);
+			}
+			
+			saveBookFile();
+			return true;
+		}
+		
+		//Method that reads the copy counters of every catalog record of a title. Returns false if the title is not in the catalog.
+		bool getCopyCounts(const string& title, uint32_t& available, uint32_t& copies) const{
+			
+			lock_guard<mutex> lock(storeMutex);
+			size_t index;
+			
+			available = copies = 0;
+			
+			if (!lookUpTitle(title, index)){
+				return false;
+			}
+			
+			for (size_t record : titleIndex.at(title)){
+				available += (*books)[record].getAvailableCopies();
+				copies += (*books)[record].getCopyCount();
+			}
+			
+			return true;
+		}
+		
+		//Method to display how many copies of a title are on the shelf.
+		void displayCopies(const string& title) const{
+			
+			uint32_t available, copies;
+			
+			if (!getCopyCounts(title, available, copies)){
+				cout << "Book not found." << endl;
+				return;
+			}
+			
+			cout << available << " of " << copies << " copies of \"" << title << "\" are available." << endl;
+		}
+		
+		//Method that returns the books whose title contains the query, ignoring case. Reads a snapshot, so writers never wait.
+		vector<Book> searchByTitle(const string& query) const{
+			return searchBooks(query, false);
+		}
+		
+		//Method that returns the books whose author contains the query, ignoring case.
+		vector<Book> searchByAuthor(const string& query) const{
+			return searchBooks(query, true);
+		}
+		
+		//Method to remove one available copy of a book by title. The title goes once its last copy is removed.
+		void removeBook(const string& title){
+			
+			{
+				lock_guard<mutex> lock(storeMutex);
+				
+				if (books->empty()){
+					cout << "Cannot remove book: Library is empty." << endl;
+					return;
+				}
+				
+				size_t index;
+				
+				if (!lookUpTitle(title, index)){
+					cout << "Book not found." << endl;
+					return;
+				}
+				
+				if (!(*books)[index].getStatus()){
+					cout << "Cannot remove book: All copies are borrowed." << endl;
+					return;
+				}
+				
+				vector<Book>& allBooks = writableBooks();
+				allBooks[index].removeAvailableCopy();
+				
+				if (allBooks[index].getCopyCount() == 0){
+					allBooks.erase(allBooks.begin() + index);
+					rebuildTitleIndex();
+				}
+			}
+			
+			saveBookFile();
+			
+			if (storageFormat == COMPACT_STORAGE){
+				saveUserFile();
+			}
+			
+			cout << "Book successfully removed." << endl;
+		}
+		
+		//Method to add user.
+		void addUser(const string& name, const string& id){
+			
+			LibraryUser user(name, id);
+			
+			{
+				lock_guard<mutex> lock(storeMutex);
+				writableUsers().emplace_back(user);
+				userPositions.insert(make_pair(id, users->size() - 1));
+				userFilter.add(id);
+				
+				if (userFilter.isFull()){
+					rebuildUserFilter();
+				}
+			}
+			
+			saveUserFile();
+		}
+		
+		//Method to remove user by id.
+		void removeUser(const string& id){
+			
+			{
+				lock_guard<mutex> lock(storeMutex);
+				
+				if (!userFilter.mightContain(id) || !isKnownUser(id)){
+					cout << "User not found." << endl;
+					return;
+				}
+				
+				//A user who was never loaded only has to be forgotten by the index.
+				auto loaded = userPositions.find(id);
+				
+				if (loaded != userPositions.end()){
+					size_t index = loaded->second;
+					vector<LibraryUser>& allUsers = writableUsers();
+					allUsers.erase(allUsers.begin() + index);
+					rebuildUserPositions();
+				} else{
+					++userVersion; //No loaded user changed, but the users file has to drop the line.
+				}
+				
+				userOffsets.erase(id);
+				rebuildUserFilter();
+			}
+			
+			saveUserFile();
+			cout << "User removed successfully." << endl;
+		}
+		
+		//Method to let a user borrow a book by title.
+		bool borrowBook(const string& userId, const string& title){
+			
+			lock_guard<mutex> lock(storeMutex);
+			size_t bookIndex;
+			
+			if (!lookUpTitle(title, bookIndex)){
+				cout << "Book not found." << endl;
+				return false;
+			}
+			
+			size_t userIndex;
+			
+			if (!lookUpUser(userId, userIndex)){
+				cout << "User not found." << endl;
+				return false;
+			}
+			
+			//Checks the shelf first, so a failed borrow neither copies the stores nor bumps their versions.
+			if (!(*books)[bookIndex].getStatus()){
+				cout << "Sorry, all copies of the book are borrowed." << endl;
+				return false;
+			}
+			
+			return writableUsers()[userIndex].borrowBook(writableBooks()[bookIndex]);
+		}
+		
+		//Method to let a user return a book by title.
+		bool returnBook(const string& userId, const string& title){
+			
+			lock_guard<mutex> lock(storeMutex);
+			size_t bookIndex;
+			
+			//Loans always refer to titles in the catalog, so an unknown title is rejected before the user is looked at.
+			if (!lookUpTitle(title, bookIndex)){
+				cout << "Book not found." << endl;
+				return false;
+			}
+			
+			size_t userIndex;
+			
+			if (!lookUpUser(userId, userIndex)){
+				cout << "User not found." << endl;
+				return false;
+			}
+			
+			//Checks the loan first, so a failed return neither copies the stores nor bumps their versions.
+			if (!(*users)[userIndex].hasBorrowed(title)){
+				cout << "You have not borrowed this book." << endl;
+				return false;
+			}
+			
+			Loan loan;
+			writableUsers()[userIndex].returnBook(title, loan);
+			
+			//Puts a borrowed copy of the title back on the shelf.
+			writableBooks()[recordForReturn(loan)].checkIn();
+			
+			return true;
+		}
+		
+		//Method to display all books in the library.
+		void displayBooks() const{
+			
+			Snapshot<Book> snapshot = snapshotBooks();
+			
+			if (snapshot.items->empty()){
+				cout << "No books in the library." << endl;
+				return;
+			}
+			
+			for (const auto& book : *snapshot.items){
+				cout << book.getDetails() << endl;
+			}
+		}
+
+		//Method to display only available books.
+		void displayAvailableBooks() const{
+			
+			Snapshot<Book> snapshot = snapshotBooks();
+			
+			if (snapshot.items->empty()){
+				cout << "No books in the library." << endl;
+				return;
+			}
+
+			bool found = false;
+			
+			for (const auto& book : *snapshot.items){
+				if (book.getStatus()){
+					cout << book.getDetails() << endl;
+					found = true;
+				}
+			}
+
+			if(!found){
+				cout << "No available books at the moment." << endl;
+			}
+		}
+		
+		//Method to display all users.
+		void displayUsers(){
+			
+			if (lazyUsers){
+				
+				//Lists the users in file order without loading the ones that were never asked for.
+				lock_guard<mutex> lock(fileMutex);
+				ostringstream listing;
+				
+				writeUsersInFileOrder(listing, nullptr);
+				
+				if (listing.str().empty()){
+					cout << "No registered users." << endl;
+				} else{
+					cout << listing.str();
+				}
+				
+				return;
+			}
+			
+			Snapshot<LibraryUser> snapshot = snapshotUsers();
+			
+			if (snapshot.items->empty()){
+				cout << "No registered users." << endl;
+				return;
+			}
+			
+			for (const auto& user : *snapshot.items){
+				cout << user.returnUserDetails() << endl;
+			}
+		}
+		
+		//Method to get a copy of the user details by id. Utilized in login function.
+		//The user is read from the users file the first time and kept in memory after that.
+		bool getUserById(const string& userId, LibraryUser& result){
+			
+			lock_guard<mutex> lock(storeMutex);
+			size_t index;
+			
+			if (!lookUpUser(userId, index)){
+				return false;
+			}
+			
+			result = (*users)[index];
+			return true;
+		}
+		
+		//Method that prints the statistics of the title and user filters.
+		void printStats(ostream& out) const{
+			
+			lock_guard<mutex> lock(storeMutex);
+			
+			titleFilter.printStats(out, "Title filter");
+			userFilter.printStats(out, "User filter");
+		}
+
+					
+};
+
+//A catalog record found in one branch of a federation.
+struct BranchHolding{
+	string branch;
+	Book book;
+};
+
+//Copies of a title held by one branch.
+struct BranchAvailability{
+	string branch;
+	uint32_t availableCopies;
+	uint32_t copies;
+};
+
+//Several branch libraries in one process. Searches and availability queries run in every branch at once.
+class LibraryFederation{
+	
+	private:
+		
+		struct Branch{
+			string name;
+			unique_ptr<Library> library;
+		};
+		
+		vector<Branch> branches;
+		StorageFormat storageFormat;
+		double filterFalsePositiveRate;
+		
+		//Private method that runs a query in every branch on its own thread and returns the results in branch order.
+		template<typename Result, typename Query>
+		vector<Result> fanOut(Query query) const{
+			
+			vector<future<Result>> pending;
+			
+			for (const auto& branch : branches){
+				pending.push_back(async(launch::async, query, cref(*branch.library)));
+			}
+			
+			vector<Result> results;
+			
+			for (auto& result : pending){
+				results.push_back(result.get());
+			}
+			
+			return results;
+		}
+		
+		//Private method that merges the matches of every branch, sorted by title and then by branch.
+		vector<BranchHolding> mergeHoldings(const vector<vector<Book>>& matches) const{
+			
+			vector<BranchHolding> holdings;
+			
+			for (size_t i = 0; i < matches.size(); ++i){
+				for (const auto& book : matches[i]){
+					holdings.push_back(BranchHolding{branches[i].name, book});
+				}
+			}
+			
+			stable_sort(holdings.begin(), holdings.end(), [](const BranchHolding& a, const BranchHolding& b){
+				return a.book.getTitle() < b.book.getTitle();
+			});
+			
+			return holdings;
+		}
+		
+	public:
+		
+		//Constructor that sets the storage format and filter false positive rate of the branches.
+		LibraryFederation(StorageFormat format = CSV_STORAGE, double filterRate = 0.01) : storageFormat(format),
+		filterFalsePositiveRate(filterRate) {}
+		
+		//Method that loads a branch from its databases. Fails if the name is taken or the books database is missing.
+		bool addBranch(const string& name, const string& booksFile, const string& usersFile){
+			
+			for (const auto& branch : branches){
+				if (branch.name == name){
+					cerr << "Error: Branch " << name << " is listed twice." << endl;
+					return false;
+				}
+			}
+			
+			if (!ifstream(storageFormat == COMPACT_STORAGE ? compactPathFor(booksFile) : booksFile).is_open()){
+				cerr << "Error: Unable to open the books database of branch " << name << "." << endl;
+				return false;
+			}
+			
+			branches.push_back(Branch{name, unique_ptr<Library>(new Library(booksFile, usersFile, storageFormat, filterFalsePositiveRate))});
+			return true;
+		}
+		
+		//Method that loads every branch listed in a NAME,BOOKS_FILE,USERS_FILE file.
+		bool loadBranches(const string& path){
+			
+			ifstream branchFile(path);
+			
+			if (!branchFile.is_open()){
+				cerr << "Error: Unable to open branches file." << endl;
+				return false;
+			}
+			
+			string line;
+			getline(branchFile, line); //Skips the header.
+			
+			while (getline(branchFile, line)){
+				
+				if (!line.empty() && line.back() == '\r'){
+					line.pop_back();
+				}
+				
+				if (line.empty()){
+					continue;
+				}
+				
+				stringstream ss(line);
+				string name, booksFile, usersFile;
+				
+				if (!getline(ss, name, ',') || !getline(ss, booksFile, ',') || !getline(ss, usersFile)){
+					cerr << "Error: Invalid branch line: " << line << endl;
+					return false;
+				}
+				
+				if (!addBranch(name, booksFile, usersFile)){
+					return false;
+				}
 			}
 			
-			userFile.close();
+			return !branches.empty();
 		}
-	
-	public:
 		
-		//Constructor that initializes by loading the values from the databases.
-		Library(const string& booksFile, const string& usersFile){
+		size_t getBranchCount() const {return branches.size();}
+		
+		//Method that searches the titles of every branch.
+		vector<BranchHolding> searchByTitle(const string& query) const{
 			
-			loadBooksFromFile();
-			loadUsersFromFile();
+			return mergeHoldings(fanOut<vector<Book>>([query](const Library& library){
+				return library.searchByTitle(query);
+			}));
 		}
 		
-		//Method that returns the vector of books.
-		vector<Book>& getBooks(){
-			return books;
+		//Method that searches the authors of every branch.
+		vector<BranchHolding> searchByAuthor(const string& query) const{
+			
+			return mergeHoldings(fanOut<vector<Book>>([query](const Library& library){
+				return library.searchByAuthor(query);
+			}));
 		}
 		
-		//Method that saves book data into the books database.
-		void saveBookFile(){ 
-
-			ofstream saveBook(bookDataBase); 
+		//Method that returns the copies of a title in every branch that holds it.
+		vector<BranchAvailability> getAvailability(const string& title) const{
 			
-			if (!saveBook){
+			//Each branch reads both counters under one lock, so they always agree.
+			vector<BranchAvailability> found = fanOut<BranchAvailability>([title](const Library& library){
 				
-				cerr << "Error: Unable open books file." << endl;
-				return;
-			}
+				BranchAvailability counts{"", 0, 0};
+				library.getCopyCounts(title, counts.availableCopies, counts.copies);
+				return counts;
+			});
 			
-			saveBook << "TITLE,AUTHOR,ISBN,STATUS" << endl;
-			 
-			for (const auto& book : books){
-				saveBook << book.toCSV() << endl;
+			vector<BranchAvailability> availability;
+			
+			for (size_t i = 0; i < found.size(); ++i){
+				if (found[i].copies > 0){
+					found[i].branch = branches[i].name;
+					availability.push_back(found[i]);
+				}
 			}
 			
-			saveBook.close();
+			return availability;
+		}
+		
+		//Method to display the books found by a search, with the branch that holds each.
+		void displayHoldings(const vector<BranchHolding>& holdings) const{
 			
-			if (saveBook.fail()){
-				cerr << "Error: Failed to save book." << endl;
-			} else {
-				cout << "Book successfully saved." << endl;
+			if (holdings.empty()){
+				cout << "No books found." << endl;
+				return;
+			}
+			
+			for (const auto& holding : holdings){
+				cout << "[" << holding.branch << "] " << holding.book.getDetails() << endl;
 			}
-		
 		}
 		
-		//Method that saves user data into the users database.
-		void saveUserFile(){
+		//Method to display how many copies of a title each branch has on its shelves.
+		void displayAvailability(const string& title) const{
 			
+			vector<BranchAvailability> availability = getAvailability(title);
 			
-			ofstream saveUser(userDataBase);
-			
-			if (!saveUser){
-				
-				cerr << "Error: Unable to open users file." << endl;
+			if (availability.empty()){
+				cout << "Book not found." << endl;
 				return;
 			}
 			
-			saveUser << "NAME,ID,BORROWED_BOOKS" << endl;
+			uint32_t available = 0;
+			uint32_t copies = 0;
 			
-			for (const auto& user : users){
-				saveUser << user.returnUserDetails() << endl;
+			for (const auto& branch : availability){
+				
+				cout << "[" << branch.branch << "] " << branch.availableCopies << " of " << branch.copies << " copies available" << endl;
+				available += branch.availableCopies;
+				copies += branch.copies;
 			}
 			
-			saveUser.close();
+			cout << "Total: " << available << " of " << copies << " copies available in " << availability.size() << " branches" << endl;
 		}
+};
+
+class TraceRecorder{
+	
+	private:
 		
-		//Method to add books.
-		void addBook(const string& title, const string& author, const string& ISBN){
-			
-			Book myBook(title, author, ISBN); //Constructor that initializes the properties of an object.
-			books.emplace_back(myBook); //the constructed object is then added to the vector.
-			saveBookFile();
-		}
+		ofstream traceFile;
+		chrono::steady_clock::time_point start;
 		
-		//Method to remove book by title.
-		void removeBook(const string& title){
+		//Private method that quotes a field containing a comma or a quote, doubling the quotes inside it.
+		static string quoteField(const string& field){
 			
-			if (books.empty()){
-				cout << "Cannot remove book: Library is empty." << endl;
-				return;
+			if (field.find_first_of(",\"") == string::npos){
+				return field;
 			}
 			
-			//This statement finds a value from the container based from the basis(predicate).
-			auto it = find_if(books.begin(), books.end(), [&title] (const Book& book){
-				return book.getTitle() == title;
-			});
+			string quoted = "\"";
 			
-			//Removes the book once it's found.
-			if (it != books.end()){
+			for (char c : field){
 				
-				books.erase(it);
-				saveBookFile();
-				cout << "Book successfully removed." << endl;
-			} else{
-				 cout << "Book not found." << endl;
+				if (c == '"'){
+					quoted += '"';
+				}
+				quoted += c;
 			}
-		}
-		
-		//Method to add user.
-		void addUser(const string& name, const string& id){
 			
-			LibraryUser user(name, id);
-			users.emplace_back(user);
-			saveUserFile();
+			return quoted + "\"";
 		}
 		
-		//Method to remove user by id.
-		void removeUser(const string& id){
+	public:
+		
+		//Constructor - the recorder stays disabled until a trace file is opened.
+		TraceRecorder() : start(chrono::steady_clock::now()) {}
+		
+		//Opens the trace file and writes its header. Timestamps are counted from this point.
+		bool open(const string& path){
 			
-			auto it = find_if(users.begin(), users.end(), [&id] (const LibraryUser& user){
-				return user.getID() == id;
-			});
+			traceFile.open(path);
 			
-			if (it != users.end()){
-				
-				users.erase(it);
-				saveUserFile();
-				cout << "User removed successfully." << endl;
-			} else{
-				cout << "User not found." << endl;
+			if (!traceFile.is_open()){
+				cerr << "Error: Unable to open trace file." << endl;
+				return false;
 			}
+			
+			traceFile << "TIMESTAMP_US,OPERATION,ARGUMENTS" << endl;
+			start = chrono::steady_clock::now();
+			return true;
 		}
 		
-		//Method to display all books in the library.
-		void displayBooks() const{
+		bool isEnabled() const {return traceFile.is_open();}
+		
+		//Writes one action as a line: microseconds since the start, operation name, then its arguments, quoted when needed.
+		void record(const string& operation, const vector<string>& arguments = vector<string>()){
 			
-			if (books.empty()){
-				cout << "No books in the library." << endl;
+			if (!isEnabled()){
 				return;
 			}
 			
-			for (const auto& book : books){
-				cout << book.toCSV() << endl;
+			long long timestamp = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+			
+			traceFile << timestamp << "," << operation;
+			
+			for (const auto& argument : arguments){
+				traceFile << "," << quoteField(argument);
 			}
+			
+			traceFile << endl;
 		}
+};
 
-		//Method to display only available books.
-		void displayAvailableBooks() const{
+class TraceReplayer{
+	
+	private:
+		
+		Library& library;
+		double rate; //Speed relative to the recording. 0 replays at full speed.
+		string currentUserId;
+		
+		map<string, vector<double>> latencies; //Latency of every replayed action in microseconds, per operation.
+		double elapsedSeconds;
+		size_t skipped; //Lines that were malformed or named an unknown operation.
+		
+		//Private method that splits a trace line into its fields. A quoted field may hold commas and doubled quotes.
+		static bool splitFields(const string& line, vector<string>& fields){
 			
-			if (books.empty()){
-				cout << "No books in the library." << endl;
-				return;
-			}
-
-			bool found = false;
+			string field;
+			bool quoted = false;
 			
-			for (const auto& book : books){
-				if (book.getStatus()){
-					cout << book.toCSV() << endl;
-					found = true;
+			for (size_t i = 0; i < line.length(); ++i){
+				
+				char c = line[i];
+				
+				if (quoted){
+					
+					if (c != '"'){
+						field += c;
+					} else if (i + 1 < line.length() && line[i + 1] == '"'){
+						field += '"';
+						++i;
+					} else{
+						quoted = false;
+					}
+					
+				} else if (c == '"' && field.empty()){
+					quoted = true;
+				} else if (c == ','){
+					fields.push_back(field);
+					field.clear();
+				} else{
+					field += c;
 				}
 			}
-
-			if(!found){
-				cout << "No available books at the moment." << endl;
-			}
+			
+			fields.push_back(field);
+			return !quoted; //An unclosed quote means the line is damaged.
 		}
 		
-		//Method to display all users.
-		void displayUsers() const{
+		//Private method that returns the given percentile of sorted latencies.
+		static double percentile(const vector<double>& sorted, double p){
 			
-			if (users.empty()){
-				cout << "No registered users." << endl;
-				return;
-			}
+			size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
 			
-			for (const auto& user : users){
-				cout << user.returnUserDetails() << endl;
-			}
+			if (rank < 1) rank = 1;
+			if (rank > sorted.size()) rank = sorted.size();
+			
+			return sorted[rank - 1];
 		}
 		
-		//Method to check if user exists by id. Utilized in login function.
-		bool checkUser(const string& userId) const{
+		//Private method that runs one action against the library the same way the dashboards do.
+		bool apply(const string& operation, const vector<string>& arguments){
 			
-			for (const auto& user : users){
+			if (operation == "login" && arguments.size() >= 1){
 				
-				if (user.getID() == userId){
-					return true;
+				LibraryUser user;
+				currentUserId = library.getUserById(arguments[0], user) ? arguments[0] : "";
+				
+			} else if (operation == "logout"){
+				
+				currentUserId.clear();
+				
+			} else if (operation == "borrow" && arguments.size() >= 1){
+				
+				if (library.borrowBook(currentUserId, arguments[0])){
+					library.saveBookFile();
+					library.saveUserFile();
+				}
+				
+			} else if (operation == "return" && arguments.size() >= 1){
+				
+				if (!currentUserId.empty() && library.returnBook(currentUserId, arguments[0])){
+					library.saveBookFile();
+					library.saveUserFile();
+				}
+				
+			} else if (operation == "display_borrowed"){
+				
+				LibraryUser user;
+				
+				if (library.getUserById(currentUserId, user)){
+					user.displayBorrowedBooks();
+				}
+				
+			} else if (operation == "display_available"){
+				
+				library.displayAvailableBooks();
+				
+			} else if (operation == "check_copies" && arguments.size() >= 1){
+				
+				library.displayCopies(arguments[0]);
+				
+			} else if (operation == "add_book" && arguments.size() >= 3){
+				
+				ISBN isbn;
+				
+				if (ISBN::parse(arguments[2], isbn)){
+					library.addBook(arguments[0], arguments[1], isbn);
 				}
+				
+			} else if (operation == "remove_book" && arguments.size() >= 1){
+				
+				library.removeBook(arguments[0]);
+				
+			} else if (operation == "add_user" && arguments.size() >= 2){
+				
+				library.addUser(arguments[0], arguments[1]);
+				
+			} else if (operation == "remove_user" && arguments.size() >= 1){
+				
+				library.removeUser(arguments[0]);
+				
+			} else if (operation == "display_books"){
+				
+				library.displayBooks();
+				
+			} else if (operation == "display_users"){
+				
+				library.displayUsers();
+				
+			} else if (operation == "display_stats"){
+				
+				library.printStats(cout);
+				
+			} else{
+				
+				return false;
 			}
 			
-			return false;
+			return true;
 		}
 		
-		//Method to get user details by id. Utilized in login function.
-		LibraryUser* getUserById(const string& userId) {
-			for (auto& user : users) {
-				if (user.getID() == userId) {
-					return &user;
+	public:
+		
+		//Constructor that binds the replayer to a library.
+		TraceReplayer(Library& lib, double r = 0) : library(lib), rate(r), elapsedSeconds(0), skipped(0) {}
+		
+		//Method that replays a trace file. Library output is muted while the actions run.
+		bool run(const string& path){
+			
+			ifstream traceFile(path);
+			
+			if (!traceFile.is_open()){
+				cerr << "Error: Unable to open trace file." << endl;
+				return false;
+			}
+			
+			string line;
+			getline(traceFile, line); //Skips the header line.
+			
+			streambuf* console = cout.rdbuf(nullptr);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			
+			while (getline(traceFile, line)){
+				
+				if (!line.empty() && line.back() == '\r'){
+					line.pop_back();
+				}
+				
+				vector<string> fields;
+				
+				if (!splitFields(line, fields) || fields.size() < 2){
+					++skipped; //Skips malformed lines.
+					continue;
+				}
+				
+				//Waits until the action is due when replaying at a scaled rate.
+				if (rate > 0){
+					long long timestamp = atoll(fields[0].c_str());
+					this_thread::sleep_until(start + chrono::microseconds(static_cast<long long>(timestamp / rate)));
+				}
+				
+				string operation = fields[1];
+				vector<string> arguments(fields.begin() + 2, fields.end());
+				
+				chrono::steady_clock::time_point before = chrono::steady_clock::now();
+				bool known = apply(operation, arguments);
+				chrono::steady_clock::time_point after = chrono::steady_clock::now();
+				
+				if (known){
+					latencies[operation].push_back(chrono::duration<double, micro>(after - before).count());
+				} else{
+					++skipped;
 				}
 			}
-			return nullptr;
+			
+			elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			cout.rdbuf(console);
+			
+			return true;
+		}
+		
+		//Method that prints throughput and latency percentiles of the last run.
+		void printReport(ostream& out){
+			
+			vector<double> all;
+			ios::fmtflags flags = out.flags();
+			streamsize precision = out.precision();
+			
+			out << "OPERATION,COUNT,P50_US,P90_US,P99_US,MAX_US" << endl;
+			out << fixed << setprecision(1);
+			
+			for (auto& entry : latencies){
+				
+				vector<double>& sorted = entry.second;
+				sort(sorted.begin(), sorted.end());
+				all.insert(all.end(), sorted.begin(), sorted.end());
+				
+				out << entry.first << "," << sorted.size() << "," << percentile(sorted, 50) << "," << percentile(sorted, 90)
+					<< "," << percentile(sorted, 99) << "," << sorted.back() << endl;
+			}
+			
+			if (skipped > 0){
+				out << "Skipped " << skipped << " malformed or unknown trace lines." << endl;
+			}
+			
+			if (all.empty()){
+				out << "No actions replayed." << endl;
+			} else{
+				
+				sort(all.begin(), all.end());
+				
+				out << "all," << all.size() << "," << percentile(all, 50) << "," << percentile(all, 90)
+					<< "," << percentile(all, 99) << "," << all.back() << endl;
+				out << setprecision(3) << "Elapsed: " << elapsedSeconds << " s, throughput: " << all.size() / elapsedSeconds << " actions/s" << endl;
+			}
+			
+			out.flags(flags);
+			out.precision(precision);
 		}
-
-					
 };
 
 class UI{
@@ -472,13 +2862,22 @@ class UI{
 	private:
 		
 		Library library;
-		LibraryUser* currentUser;
+		string currentUserId; //Empty when no user is logged in.
+		TraceRecorder* recorder; //Records the dashboard actions when tracing is on.
 		
 		//Private method that clears the console screen.
 		void clearScreen(){
 			cout << "\033[2J\033[1;1H"; // ANSI escape codes
 		}
 		
+		//Private method that writes a dashboard action to the trace, if one is being recorded.
+		void traceAction(const string& operation, const vector<string>& arguments = vector<string>()){
+			
+			if (recorder){
+				recorder->record(operation, arguments);
+			}
+		}
+		
 		//Private method that waits for user to press enter.
 		void pressEnterToContinue(){
 			cout << "\nPress Enter to continue...";
@@ -488,8 +2887,9 @@ class UI{
 		
 	public:
 		
-		//Constructor that initializes the library with the book and user databases also sets current user to null.
-		UI() : library(bookDataBase, userDataBase), currentUser(nullptr) {}
+		//Constructor that initializes the library with the book and user databases also sets current user to none.
+		UI(TraceRecorder* traceRecorder = nullptr, StorageFormat format = CSV_STORAGE, double filterFalsePositiveRate = 0.01)
+		: library(bookDataBase, userDataBase, format, filterFalsePositiveRate), currentUserId(), recorder(traceRecorder) {}
 		
 		//Method to display the login screen.
 		void showLoginScreen(){
@@ -519,7 +2919,8 @@ class UI{
 			cout << "2. Return book\n";
 			cout << "3. Display all books borrowed\n";
 			cout << "4. Show available books\n";
-			cout << "5. Logout\n";
+			cout << "5. Check copies of a book\n";
+			cout << "6. Logout\n";
 		}
 	
 		//Method to display the librarian dashboard.
@@ -538,7 +2939,8 @@ class UI{
 			cout << "4. Remove user\n";
 			cout << "5. Display all books\n";
 			cout << "6. Display all users\n";
-			cout << "7. Logout\n";
+			cout << "7. Display statistics\n";
+			cout << "8. Logout\n";
 		}
 		
 		//Method to display messages and wait for user to press enter.
@@ -611,10 +3013,13 @@ class UI{
 			cout << "=========================\n";
 			
 			string userId = getTextInput("Enter your id: ");
+			traceAction("login", {userId});
+			
+			LibraryUser user;
 			
-			if (library.checkUser(userId)){
-				currentUser = library.getUserById(userId);
-				showMessage("Login successful: Welcome " + currentUser->getName() + "!");
+			if (library.getUserById(userId, user)){
+				currentUserId = userId;
+				showMessage("Login successful: Welcome " + user.getName() + "!");
 				return true;
 			} else{
 				showMessage("User ID is not found. Please try again or contact the librarian for assistance.");
@@ -660,40 +3065,33 @@ class UI{
 			while (running){
 				
 				showUserScreen();
-				int option = getNumberInput("Choose an option: ", 1, 5);
+				int option = getNumberInput("Choose an option: ", 1, 6);
 				
 				switch (option){
 					
 					case 1:{
 						
 						string titleToBorrow = getTextInput("Enter the title of the book to borrow: ");
+						traceAction("borrow", {titleToBorrow});
 						
-						//Finds the book in the library.
-						auto bookIt = find_if(library.getBooks().begin(), library.getBooks().end(), [&titleToBorrow]
-						(const Book& book) {
-							return book.getTitle() == titleToBorrow;
-						});
-						
-						if (bookIt != library.getBooks().end()){
-							
-							if (currentUser->borrowBook(*bookIt)){
-								showMessage("Book has been borrowed successfully!");
-								library.saveBookFile();
-								library.saveUserFile();
-							} else{
-								showMessage("Book is not available for borrowing."); //prints if book is already borrowed or doesn't exist.
-							} 
-						}
+						if (library.borrowBook(currentUserId, titleToBorrow)){
+							showMessage("Book has been borrowed successfully!");
+							library.saveBookFile();
+							library.saveUserFile();
+						} else{
+							showMessage("Book is not available for borrowing."); //prints if book is already borrowed or doesn't exist.
+						} 
 						
 						break;
 					}
 					
 					case 2: {
 						
-						if (currentUser){
+						if (!currentUserId.empty()){
 							
 							string titleToReturn = getTextInput("Enter the title to return: ");
-							bool success = currentUser->returnBook(titleToReturn, library.getBooks());
+							traceAction("return", {titleToReturn});
+							bool success = library.returnBook(currentUserId, titleToReturn);
 							
 							if(success){
 								showMessage("Book has been returned successfully!");
@@ -709,12 +3107,15 @@ class UI{
 					
 					case 3: {
 						
-						if (currentUser){
+						traceAction("display_borrowed");
+						LibraryUser user;
+						
+						if (library.getUserById(currentUserId, user)){
 							
 							clearScreen();
 							
 							cout << "-------- BORROWED BOOKS --------\n";
-							currentUser->displayBorrowedBooks();
+							user.displayBorrowedBooks();
 							pressEnterToContinue();
 							
 						}
@@ -723,6 +3124,7 @@ class UI{
 					
 					case 4: {
 						
+						traceAction("display_available");
 						cout << "-------- AVAILABLE BOOKS --------\n";
 						
 						library.displayAvailableBooks();
@@ -732,7 +3134,18 @@ class UI{
 					
 					case 5: {
 						
-						currentUser = nullptr;
+						string title = getTextInput("Enter the title of the book: ");
+						traceAction("check_copies", {title});
+						
+						library.displayCopies(title);
+						pressEnterToContinue();
+						break;
+					}
+					
+					case 6: {
+						
+						traceAction("logout");
+						currentUserId.clear();
 						running = false;
 						showMessage("Logged out successfully!");
 						break;
@@ -748,7 +3161,7 @@ class UI{
 			while(running){
 				
 				showLibrarianScreen();
-				int option = getNumberInput("Choose an option: ", 1, 7);
+				int option = getNumberInput("Choose an option: ", 1, 8);
 				
 				switch(option){
 					
@@ -756,10 +3169,20 @@ class UI{
 						
 						string title = getTextInput("Enter the title: ");
 						string author = getTextInput("Enter the name of the author: ");
-						string isbn = getTextInput("Enter ISBN number: ");
+						string isbnStr = getTextInput("Enter ISBN number: ");
+						traceAction("add_book", {title, author, isbnStr});
+						
+						ISBN isbn;
+						if (!ISBN::parse(isbnStr, isbn)){
+							showMessage("Invalid ISBN: Please enter a valid ISBN-10 or ISBN-13.");
+							break;
+						}
 						
-						library.addBook(title, author, isbn);
-						showMessage("Book added successfully!");
+						if (library.addBook(title, author, isbn)){
+							showMessage("Book added successfully!");
+						} else {
+							pressEnterToContinue();
+						}
 						
 						break;
 					}
@@ -767,6 +3190,7 @@ class UI{
 					case 2: {
 						
 						string titleToRemove = getTextInput("Enter the title of the book to be removed: ");
+						traceAction("remove_book", {titleToRemove});
 						library.removeBook(titleToRemove);
 						showMessage("Book has been removed in the library.");
 						break;
@@ -776,6 +3200,7 @@ class UI{
 						
 						string userName = getTextInput("Enter name: ");
 						string userId = getTextInput("Enter id: ");
+						traceAction("add_user", {userName, userId});
 						
 						library.addUser(userName, userId);
 						showMessage("User is now registered!");
@@ -785,6 +3210,7 @@ class UI{
 					case 4: {
 						
 						string userIdToRemove = getTextInput("Enter user ID to remove: ");						
+						traceAction("remove_user", {userIdToRemove});
 						library.removeUser(userIdToRemove);
 						break;
 					}
@@ -793,6 +3219,7 @@ class UI{
 						
 						clearScreen();
 						
+						traceAction("display_books");
 						cout << "-------- ALL BOOKS --------\n";
 						library.displayBooks();
 						pressEnterToContinue();
@@ -803,6 +3230,7 @@ class UI{
 						
 						clearScreen();
 						
+						traceAction("display_users");
 						cout << "-------- ALL USERS --------\n";
 						library.displayUsers();
 						pressEnterToContinue();
@@ -811,6 +3239,17 @@ class UI{
 					
 					case 7: {
 						
+						clearScreen();
+						
+						traceAction("display_stats");
+						cout << "-------- STATISTICS --------\n";
+						library.printStats(cout);
+						pressEnterToContinue();
+						break;
+					}
+					
+					case 8: {
+						
 						running = false;
 						showMessage("Logged out successfully!");
 						break;
@@ -820,10 +3259,140 @@ class UI{
 		}
 };
 
-int main()
+int main(int argc, char* argv[])
 {
 	
-	UI ui;
+	string tracePath;
+	string replayPath;
+	double replayRate = 0;
+	bool replaySave = true;
+	StorageFormat format = CSV_STORAGE;
+	bool convert = false;
+	StorageFormat convertTo = CSV_STORAGE;
+	double filterRate = 0.01;
+	string branchesPath;
+	string searchTitle;
+	string searchAuthor;
+	string availabilityTitle;
+	
+	//Reads the command line options.
+	for (int i = 1; i < argc; ++i){
+		
+		string arg = argv[i];
+		
+		if (arg == "--trace" && i + 1 < argc){
+			tracePath = argv[++i];
+		} else if (arg == "--replay" && i + 1 < argc){
+			replayPath = argv[++i];
+		} else if (arg == "--rate" && i + 1 < argc){
+			replayRate = atof(argv[++i]);
+		} else if (arg == "--no-save"){
+			replaySave = false;
+		} else if (arg == "--filter-fp" && i + 1 < argc){
+			
+			filterRate = atof(argv[++i]);
+			
+			if (filterRate <= 0 || filterRate >= 1){
+				cerr << "Error: --filter-fp must be between 0 and 1." << endl;
+				return 1;
+			}
+		} else if (arg == "--branches" && i + 1 < argc){
+			branchesPath = argv[++i];
+		} else if (arg == "--search-title" && i + 1 < argc){
+			searchTitle = argv[++i];
+		} else if (arg == "--search-author" && i + 1 < argc){
+			searchAuthor = argv[++i];
+		} else if (arg == "--availability" && i + 1 < argc){
+			availabilityTitle = argv[++i];
+		} else if (arg == "--compact"){
+			format = COMPACT_STORAGE;
+		} else if (arg == "--convert-to-compact"){
+			convert = true;
+			convertTo = COMPACT_STORAGE;
+		} else if (arg == "--convert-to-csv"){
+			convert = true;
+			convertTo = CSV_STORAGE;
+			format = COMPACT_STORAGE;
+		} else{
+			cerr << "Usage: " << argv[0] << " [--compact] [--filter-fp RATE] [--trace FILE] | [--replay FILE [--rate N] [--no-save]]"
+				 << " | --convert-to-compact | --convert-to-csv"
+				 << " | --branches FILE [--search-title TEXT] [--search-author TEXT] [--availability TITLE]" << endl;
+			return 1;
+		}
+	}
+	
+	//Rewrites the databases in the other format.
+	if (convert){
+		
+		//Refuses to convert when there is nothing to read, so the other format is not overwritten with an empty library.
+		if (!ifstream(format == COMPACT_STORAGE ? compactPathFor(bookDataBase) : bookDataBase).is_open()){
+			cerr << "Error: Unable to open the databases to convert." << endl;
+			return 1;
+		}
+		
+		Library library(bookDataBase, userDataBase, format);
+		library.setStorageFormat(convertTo);
+		library.saveBookFile();
+		library.saveUserFile();
+		return 0;
+	}
+	
+	//Answers searches across every branch listed in the branches file.
+	if (!branchesPath.empty()){
+		
+		if (searchTitle.empty() && searchAuthor.empty() && availabilityTitle.empty()){
+			cerr << "Error: --branches needs --search-title, --search-author or --availability." << endl;
+			return 1;
+		}
+		
+		LibraryFederation federation(format, filterRate);
+		
+		if (!federation.loadBranches(branchesPath)){
+			return 1;
+		}
+		
+		if (!searchTitle.empty()){
+			cout << "-------- TITLES MATCHING \"" << searchTitle << "\" --------\n";
+			federation.displayHoldings(federation.searchByTitle(searchTitle));
+		}
+		
+		if (!searchAuthor.empty()){
+			cout << "-------- AUTHORS MATCHING \"" << searchAuthor << "\" --------\n";
+			federation.displayHoldings(federation.searchByAuthor(searchAuthor));
+		}
+		
+		if (!availabilityTitle.empty()){
+			cout << "-------- AVAILABILITY OF \"" << availabilityTitle << "\" --------\n";
+			federation.displayAvailability(availabilityTitle);
+		}
+		
+		return 0;
+	}
+	
+	//Replays a recorded session against the library and reports how fast it ran.
+	if (!replayPath.empty()){
+		
+		Library library(bookDataBase, userDataBase, format, filterRate);
+		library.setSaveEnabled(replaySave);
+		
+		TraceReplayer replayer(library, replayRate);
+		
+		if (!replayer.run(replayPath)){
+			return 1;
+		}
+		
+		replayer.printReport(cout);
+		library.printStats(cout);
+		return 0;
+	}
+	
+	TraceRecorder recorder;
+	
+	if (!tracePath.empty() && !recorder.open(tracePath)){
+		return 1;
+	}
+	
+	UI ui(recorder.isEnabled() ? &recorder : nullptr, format, filterRate);
 	
 	ui.showLoginScreen();
 	int option = ui.getNumberInput("Choose an option: ", 1, 3);
@@ -842,4 +3411,4 @@ int main()
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file